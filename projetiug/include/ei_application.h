@@ -15,6 +15,7 @@
 #include "ei_types.h"
 #include "ei_event.h"
 #include "ei_widget.h"
+#include "ei_rendercache.h"
 
 namespace ei {
 
@@ -58,6 +59,61 @@ public:
      */
     void invalidate_rect(const Rect &rect);
 
+    /**
+     * \brief Adds a rectangle where the geometry or the stacking of the widgets changed. It is
+     *    redrawn, and so is the picking buffer (see \ref use_pick_buffer), which is left as is
+     *    in the rectangles of \ref invalidate_rect: they only change the appearance.
+     *
+     * @param rect    The rectangle to add, expressed in the root window coordinates.
+     */
+    void invalidate_geometry(const Rect &rect);
+
+    /**
+     * \brief Chooses how the widget under the pointer is found. By default, it is found
+     *    geometrically by \ref Widget::pick(const Point&). Otherwise, the widgets are also drawn
+     *    with their pick id in an \ref IdBuffer, where the id under the pointer is read.
+     *
+     * @param enabled           EI_TRUE to draw and read the picking buffer.
+     * @param half_resolution   If EI_TRUE, the buffer keeps one id per block of 2x2 pixels.
+     */
+    void use_pick_buffer(bool_t enabled, bool_t half_resolution = EI_FALSE);
+
+    /**
+     * \brief Returns the picking buffer.
+     *
+     * @return      The buffer, or NULL if the widgets are picked geometrically.
+     */
+    IdBuffer* pick_buffer();
+
+    /**
+     * \brief Redraws the invalidated rectangles and updates them on screen. Called by \ref run
+     *    before waiting for each event.
+     */
+    void redraw();
+
+    /**
+     * @return      The rectangles added by \ref invalidate_rect since the last redraw.
+     */
+    const std::vector<Rect>& invalidated_rects() const;
+
+    /**
+     * @return      The rectangles added by \ref invalidate_geometry since the last redraw.
+     */
+    const std::vector<Rect>& invalidated_geometry() const;
+
+    /**
+     * \brief Sets the memory of the offscreens of the retained widgets (see
+     *    \ref Widget::set_retained), beyond which the least recently used ones are freed.
+     *
+     * @param bytes   The budget, \ref RenderCache::k_default_budget by default.
+     */
+    void set_render_cache_budget(size_t bytes);
+
+    /**
+     * \brief Returns the counters of the offscreens of the retained widgets, since the start.
+     */
+    const render_cache_stats_t& render_cache_stats() const;
+
     /**
      * \brief Tells the application to quite. Is usually called by an event handler (for example
      *    when pressing the "Escape" key).
@@ -79,6 +135,24 @@ public:
      * @return      The surface of the root window.
      */
     surface_t root_surface();
+
+    /**
+     * \brief Returns the running application, used by the widgets and geometry managers to
+     *    invalidate the parts of the screen they change.
+     *
+     * @return      The application, or NULL if none was created.
+     */
+    static Application* getInstance();
+
+private:
+    static Application* s_instance;
+
+    surface_t           m_root_surface;   ///< The root window.
+    IdBuffer*           m_pick_buffer;    ///< Where widgets are drawn with their pick id, or NULL.
+    Frame*              m_root_widget;    ///< The widget covering the root window.
+    std::vector<Rect>   m_invalidated;    ///< Rectangles to redraw on the next iteration of the main loop.
+    std::vector<Rect>   m_pick_invalidated; ///< Rectangles to redraw in the picking buffer too.
+    bool_t              m_quit;           ///< Set by \ref quit_request.
 };
 
 }
@@ -0,0 +1,98 @@
+/**
+ *  @file ei_configurebatch.h
+ *  @brief  Batches of configure calls: the geometry and the damaged areas of many widgets are
+ *    updated once, when the batch is committed.
+ *
+ *  \code
+ *  ConfigureBatch::getInstance().begin();
+ *  for (int i = 0; i < count; i++)
+ *      labels[i]->configure(...);
+ *  ConfigureBatch::getInstance().commit();
+ *  \endcode
+ *
+ */
+
+#ifndef EI_CONFIGUREBATCH_H
+#define EI_CONFIGUREBATCH_H
+
+#include <vector>
+
+#include "ei_types.h"
+#include "ei_widgetstore.h"
+
+namespace ei {
+
+class ConfigureBatch
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static ConfigureBatch& getInstance() {
+        static ConfigureBatch instance;
+        return instance;
+    }
+private:
+    ConfigureBatch();
+
+public:
+    ConfigureBatch(ConfigureBatch const&)   = delete;
+    void operator=(ConfigureBatch const&) = delete;
+
+    static const int k_max_rects = 16;  ///< Damaged rectangles kept apart by a batch, they are merged in one beyond.
+
+    /**
+     * \brief   Opens a batch, batches may be nested: the changes are applied by the outermost
+     *          \ref commit.
+     */
+    void begin();
+
+    /**
+     * \brief   Closes a batch. The widgets configured in it are placed again, a subtree once
+     *          even if several of its widgets changed, then their areas are invalidated.
+     */
+    void commit();
+
+    /**
+     * @return  EI_TRUE between \ref begin and \ref commit.
+     */
+    bool_t open() const;
+
+    /**
+     * \brief   Records that a widget must be placed again by its geometry manager.
+     *
+     * @return  EI_FALSE if no batch is open: the caller places it at once.
+     */
+    bool_t defer_run(WidgetStore::handle_t handle);
+
+    /**
+     * \brief   Records a damaged rectangle, merged with the ones it overlaps or touches.
+     *
+     * @param   geometry    EI_TRUE if the picking changes too, see \ref Application::invalidate_geometry.
+     *
+     * @return  EI_FALSE if no batch is open: the caller invalidates it at once.
+     */
+    bool_t defer_invalidate(const Rect& rect, bool_t geometry);
+
+    /**
+     * \brief   Forgets a widget that is destroyed.
+     */
+    void remove(WidgetStore::handle_t handle);
+
+private:
+    /**
+     * \brief   Adds a rectangle to a list, merged with the ones it overlaps or touches.
+     */
+    static void merge(std::vector<Rect>& rects, const Rect& rect);
+
+    int                                 m_depth;        ///< Number of nested batches.
+    bool_t                              m_committing;   ///< EI_TRUE while the widgets are placed by \ref commit.
+    std::vector<WidgetStore::handle_t>  m_pending;      ///< Widgets to place, in the order they changed.
+    std::vector<bool_t>                 m_marked;       ///< One per handle, EI_TRUE if it is pending.
+    std::vector<Rect>                   m_invalidated;
+    std::vector<Rect>                   m_pick_invalidated;
+};
+
+}
+
+#endif
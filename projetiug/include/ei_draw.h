@@ -13,6 +13,8 @@
 #define EI_DRAW_H
 
 #include <stdint.h>
+#include <map>
+#include <vector>
 #include "ei_types.h"
 #include "hw_interface.h"
 
@@ -63,10 +65,328 @@ void draw_line(surface_t surface, const Point &start,
  *                    then this pixel is drawn only once.
  * @param color       The color used to draw the line, alpha channel is managed.
  * @param clipper     If not NULL, the drawing is restricted within this rectangle.
+ * @param decimated   If EI_TRUE, the consecutive points in a same pixel column are merged into
+ *                    a single vertical segment, from their minimum to their maximum ordinate,
+ *                    while the list is walked: the pixels are the same, but a line of millions
+ *                    of samples only draws a few segments per column. A translucent color is then
+ *                    blended fewer times on the pixels that many segments cover.
  */
 void draw_polyline(surface_t surface,
                       const linked_point_t* first_point,
-                      const color_t color, const Rect* clipper);
+                      const color_t color, const Rect* clipper,
+                      bool_t decimated = EI_FALSE);
+
+/**
+ * \brief   A filled polygon whose sorted edge table is built once. It is then drawn at any
+ *          integer translation, with any color and clipper, without rebuilding its edges.
+ *
+ *          It is drawn either aliased, filling the pixels crossed by its scanlines, or
+ *          anti-aliased: the exact area of every pixel covered by the polygon, whose points
+ *          are then at the corners of the pixels, is accumulated in a single pass.
+ */
+class Path {
+public:
+    Path();
+
+    /**
+     * \brief   Builds the path of a polygon, see \ref set_points.
+     */
+    explicit Path(const linked_point_t* first_point);
+
+    /**
+     * \brief   Replaces the polygon of the path and builds its edge table.
+     *
+     * @param   first_point The head of a linked list of the points of the polygon, the last
+     *                      point is linked back to the first one. NULL empties the path.
+     */
+    void set_points(const linked_point_t* first_point);
+
+    /**
+     * \brief   Replaces the polygon of the path by sub-pixel points.
+     *
+     * @param   coordinates The abscissa and ordinate of every point, the last point is linked
+     *                      back to the first one. The aliased drawing rounds them.
+     */
+    void set_points(const std::vector<float>& coordinates);
+
+    /**
+     * @return  EI_TRUE if drawing the path draws nothing.
+     */
+    bool_t empty() const;
+
+    /**
+     * @return  The smallest rectangle containing the pixels filled by the path, when it is
+     *          drawn without translation.
+     */
+    Rect bounding_box() const;
+
+    /**
+     * @return  The smallest rectangle containing the pixels covered by the anti-aliased path,
+     *          when it is drawn without translation.
+     */
+    Rect coverage_box() const;
+
+    /**
+     * \brief   Fills the polygon.
+     *
+     * @param   surface Where to draw the polygon.
+     * @param   offset  Translation added to the points of the polygon.
+     * @param   color   The color used to draw the polygon, alpha channel is managed.
+     * @param   clipper If not NULL, the drawing is restricted within this rectangle.
+     * @param   antialiased If EI_TRUE, the edges are blended with the coverage of their pixels.
+     */
+    void draw(surface_t surface, const Point& offset, const color_t& color, const Rect* clipper,
+              bool_t antialiased = EI_FALSE) const;
+
+private:
+    friend class Mask;
+
+    void build();
+
+    /**
+     * \brief   Calls span(y, x0, x1) for every horizontal span [x0, x1] of the polygon on
+     *          scanline y, restricted to x0 <= x <= x1 and y0 <= y < y1.
+     */
+    template <typename SpanFunction>
+    void scan(int clip_x0, int clip_y0, int clip_x1, int clip_y1, SpanFunction span) const;
+
+    /**
+     * \brief   Calls run(y, x, count, coverage) for every run of pixels of scanline y covered
+     *          by the polygon, restricted like \ref scan. "coverage" holds the coverage of the
+     *          "count" pixels from 0 to 255, it is NULL when they are entirely covered.
+     */
+    template <typename RunFunction>
+    void scan_coverage(int clip_x0, int clip_y0, int clip_x1, int clip_y1, RunFunction run) const;
+
+    struct edge_t {
+        int y_min;      ///< Min ordinate
+        int y_max;      ///< Max ordinate
+        int x_min;      ///< Abscissa of the lower end
+        int dx;         ///< Displacement along x axis
+        int dy;         ///< Displacement along y axis
+        int stepx;      ///< Step along x axis (+/-1)
+        int fraction;   ///< Bresenham error term
+    };
+
+    struct segment_t {
+        float x_top, y_top;     ///< Upper end
+        float y_bottom;         ///< Ordinate of the lower end
+        float dxdy;             ///< Displacement along x axis per unit of y
+        float direction;        ///< +1 if the polygon goes down along the segment, -1 otherwise
+    };
+
+    std::vector<float> m_points;                ///< Coordinates of the points of the polygon.
+    std::vector<edge_t> m_edges;                ///< Edge table, sorted by increasing y and x of the lower end.
+    mutable std::vector<edge_t> m_active_edges; ///< Active edge table, kept to be reused by the next draw.
+    int m_min_scanline, m_max_scanline;
+    int m_min_x, m_max_x;
+
+    std::vector<segment_t> m_segments;              ///< Segments of the polygon, sorted by increasing y_top.
+    mutable std::vector<size_t> m_active_segments;  ///< Segments crossing the current scanline.
+    mutable std::vector<float> m_cells;             ///< Signed areas accumulated along a scanline.
+    mutable std::vector<std::pair<int, int> > m_touched;    ///< Ranges of the cells modified on a scanline.
+    mutable std::vector<unsigned char> m_coverage;  ///< Coverage of the pixels of a scanline.
+    Rect m_coverage_box;
+};
+
+/**
+ * \brief   Builds the path of a rounded frame, see \ref rounded_frame.
+ */
+Path rounded_frame_path(const Rect& rect, float radius, bt_part part);
+
+/**
+ * \brief   Fills a rectangle with rounded corners. The span of every row is computed from the
+ *          circle equation of the corners, without building any polygon.
+ *
+ * @param   surface Where to draw the rectangle.
+ * @param   rect    The rectangle.
+ * @param   radius  The radius of the corners, 0 for a plain rectangle. It is reduced to half
+ *                  the smallest side of the rectangle.
+ * @param   color   The color used to fill the rectangle, alpha channel is managed.
+ * @param   clipper If not NULL, the drawing is restricted within this rectangle.
+ */
+void fill_rounded_rect(surface_t surface, const Rect& rect, int radius,
+                       const color_t& color, const Rect* clipper);
+
+/**
+ * \brief   Tells if a pixel is filled by \ref fill_rounded_rect, without drawing it.
+ */
+bool_t rounded_rect_contains(const Rect& rect, int radius, const Point& where);
+
+/**
+ * \brief   A buffer of 32-bit ids, one per pixel or per block of 2x2 pixels of the screen, where
+ *          the widgets are drawn for picking. It lives in memory: an id is read back by indexing
+ *          an array, without the backend nor any conversion from a color.
+ */
+class IdBuffer {
+public:
+    static const uint32_t k_no_id = 0xffffffff;    ///< Id of the pixels where nothing was drawn.
+
+    IdBuffer();
+
+    /**
+     * \brief   Sets the size of the buffer, in pixels of the screen, and fills it with k_no_id.
+     *
+     * @param   half_resolution     If EI_TRUE, one id is kept per block of 2x2 pixels, the one
+     *                              of its top-left pixel.
+     */
+    void resize(const Size& size, bool_t half_resolution);
+
+    /**
+     * @return  The size of the buffer, in pixels of the screen.
+     */
+    const Size& size() const
+    {
+        return m_size;
+    }
+
+    /**
+     * \brief   Writes an id on the pixels [x0, x1] of the row y, which must be in the buffer.
+     */
+    void fill_span(int y, int x0, int x1, uint32_t id);
+
+    /**
+     * @return  The id at a pixel of the screen, k_no_id outside of the buffer.
+     */
+    uint32_t at(const Point& where) const
+    {
+        if (where.x < 0 || where.y < 0 || where.x >= (int)m_size.width || where.y >= (int)m_size.height)
+            return k_no_id;
+        return m_ids[(where.y >> m_shift) * m_width + (where.x >> m_shift)];
+    }
+
+private:
+    Size                    m_size;
+    int                     m_shift;    ///< 1 at half resolution, 0 otherwise.
+    int                     m_width;    ///< Number of ids per row.
+    int                     m_height;
+    std::vector<uint32_t>   m_ids;
+};
+
+/**
+ * \brief   Writes an id on the pixels of \ref fill_rounded_rect, with the same rasterization.
+ */
+void fill_rounded_rect(IdBuffer& buffer, const Rect& rect, int radius,
+                       uint32_t id, const Rect* clipper);
+
+/**
+ * \brief   Fills a rectangle with rounded corners in color, and writes an id on the same pixels
+ *          of an id buffer, in a single pass: the spans are computed and clipped once.
+ *
+ * @param   buffer  The id buffer, or NULL to only draw the color.
+ */
+void fill_rounded_rect(surface_t surface, IdBuffer* buffer, const Rect& rect, int radius,
+                       const color_t& color, uint32_t id, const Rect* clipper);
+
+/**
+ * \brief   Fills a disc, the span of every row is computed from the circle equation.
+ *
+ * @param   surface Where to draw the disc.
+ * @param   center  The center of the disc.
+ * @param   radius  The radius of the disc, 0 fills the center pixel only.
+ * @param   color   The color used to fill the disc, alpha channel is managed.
+ * @param   clipper If not NULL, the drawing is restricted within this rectangle.
+ */
+void fill_circle(surface_t surface, const Point& center, int radius,
+                 const color_t& color, const Rect* clipper);
+
+/**
+ * \brief   An 8-bit coverage mask of a shape, rasterized once with anti-aliasing. It is then
+ *          drawn at any position and in any color by blending the color weighted by the coverage.
+ */
+class Mask {
+public:
+    /**
+     * \brief   Rasterizes a path, minus an optional hole.
+     */
+    Mask(const Path& path, const Path* hole = NULL);
+    ~Mask();
+
+    Mask(const Mask&) = delete;
+    void operator=(const Mask&) = delete;
+
+    /**
+     * @return  The covered rectangle, relatively to the position given to \ref draw.
+     */
+    const Rect& rect() const;
+
+    /**
+     * \brief   Blends a color on a surface, weighted by the coverage.
+     *
+     * @param   surface Where to draw the mask.
+     * @param   where   Translation of the shape in the surface.
+     * @param   color   The color, alpha channel is managed.
+     * @param   clipper If not NULL, the drawing is restricted within this rectangle.
+     */
+    void draw(surface_t surface, const Point& where, const color_t& color, const Rect* clipper) const;
+
+private:
+    struct run_t {
+        int begin, end;
+    };
+
+    Rect m_rect;                            ///< Bounding box of the shape.
+    std::vector<unsigned char> m_coverage;  ///< Coverage of the pixels of m_rect, row by row.
+    std::vector<run_t> m_opaque_runs;       ///< Longest run of fully covered pixels of every row, filled without blending the coverage.
+    mutable surface_t m_surface;            ///< Coverage uploaded to the backend, created on the first draw.
+};
+
+/**
+ * \brief   Masks of the shapes used by the widgets, which are the same on every frame
+ *          whatever their color or position. The radii are rounded to 1/16 of a pixel.
+ *          The references to the masks stay valid until \ref trim or \ref clear.
+ */
+class MaskCache {
+public:
+    /**
+     * @return the singleton instance
+     */
+    static MaskCache& getInstance() {
+        static MaskCache instance;
+        return instance;
+    }
+
+    MaskCache(MaskCache const&)      = delete;
+    void operator=(MaskCache const&) = delete;
+
+    /**
+     * @return  The mask of \ref rounded_frame for a rectangle at the origin.
+     */
+    const Mask& rounded_frame(const Size& size, float radius, bt_part part);
+
+    /**
+     * @return  The mask of the outline of a rounded frame at the origin, "width" pixels wide.
+     */
+    const Mask& rounded_ring(const Size& size, float radius, int width);
+
+    /**
+     * \brief   Frees all masks if there are more than \ref k_max_masks, as sizes change when
+     *          widgets are resized. Called between two frames, when no mask is referenced.
+     */
+    void trim();
+
+    /**
+     * \brief   Frees all masks. Must be called before the backend is released.
+     */
+    void clear();
+
+    static const size_t k_max_masks = 256;  ///< Number of masks kept by \ref trim.
+    static const int k_radius_steps = 16;   ///< Steps of the radii in the keys, per pixel.
+
+private:
+    MaskCache();
+    ~MaskCache();
+
+    struct key_t {
+        int kind;
+        int width, height;
+        int radius;     ///< In 1/\ref k_radius_steps of a pixel.
+        int parameter;
+        bool operator<(const key_t& other) const;
+    };
+
+    std::map<key_t, Mask*> m_masks;
+};
 
 /**
  * \brief Draws a filled polygon.
@@ -76,9 +396,31 @@ void draw_polyline(surface_t surface,
  *                    It is either NULL (i.e. draws nothing), or has more than 2 points.
  * @param color       The color used to draw the polygon, alpha channel is managed.
  * @param clipper     If not NULL, the drawing is restricted within this rectangle.
+ * @param antialiased If EI_TRUE, the edges are blended with the exact coverage of their pixels,
+ *                    the points being at the corners of the pixels (see \ref Path).
  */
 void draw_polygon(surface_t surface, const linked_point_t* first_point,
-                     const color_t &color, const Rect* clipper);
+                     const color_t &color, const Rect* clipper, bool_t antialiased = EI_FALSE);
+
+/**
+ * \brief A polygon of a batch drawn by \ref draw_polygons.
+ */
+typedef struct {
+    const linked_point_t* first_point;  ///< The points of the polygon, as for \ref draw_polygon.
+    color_t color;                      ///< The color of the polygon, alpha channel is managed.
+} polygon_t;
+
+/**
+ * \brief Draws a batch of filled polygons, as many calls to \ref draw_polygon would in the
+ *        order of the batch, but with a single lock of the surface and a single scanline sweep
+ *        over the edges of all the polygons.
+ *
+ * @param surface     Where to draw the polygons.
+ * @param polygons    The polygons, later ones are drawn over the previous ones where they overlap.
+ * @param count       The number of polygons.
+ * @param clipper     If not NULL, the drawing is restricted within this rectangle.
+ */
+void draw_polygons(surface_t surface, const polygon_t* polygons, int count, const Rect* clipper);
 
 /**
  * \brief Draws text by calling \ref hw_text_create_surface.
@@ -116,10 +458,142 @@ void fill(surface_t surface, const color_t* color, const bool_t use_alpha);
  *                    weighted by the source alpha channel. The transparency of the final pixels is set to opaque.
  *                    If false, the final pixels are an exact copy of the source pixels, including the alpha channel.
  *
- *
+ *        Within a \ref BlitBatch, the copy is queued: the source must stay alive until the batch
+ *        is submitted.
  */
 void ei_copy_surface(surface_t destination, const surface_t source,
                      const Point* where, const bool_t use_alpha);
 
+/**
+ * \brief   Allocates an off-screen surface in a given pixel format, like \ref hw_surface_create.
+ *          The primitives draw on every format, and \ref ei_copy_surface converts between them:
+ *          surfaces that need no alpha or no color should use the smaller formats.
+ *
+ * @param   root      The root window.
+ * @param   size      Number of horizontal and vertical pixels.
+ * @param   format    The pixel format. If the backend does not support it, the surface is
+ *                    created in \ref ei_format_rgba8888.
+ *
+ * @return  The surface, to be freed by calling \ref hw_surface_free.
+ */
+surface_t create_surface(const surface_t root, const Size* size, surface_format_t format);
+
+/**
+ * \brief   Returns the pixel format of a surface, \ref ei_format_rgba8888 for the surfaces of
+ *          \ref hw_surface_create.
+ */
+surface_format_t surface_get_format(const surface_t surface);
+
+/**
+ * \brief   Creates a view of a rectangle of a surface: a surface sharing the pixels of the
+ *          rectangle without copying them, whose origin is the top-left corner of the rectangle.
+ *          Every primitive draws into a view and reads from it as from any surface, clipped to
+ *          its bounds. Creating a view copies no pixel.
+ *
+ * @param   surface   The parent surface, which must outlive the view. It can be a view itself.
+ * @param   rect      The rectangle of the parent, clipped to it.
+ *
+ * @return  The view, in the pixel format of its parent. It is freed by calling
+ *          \ref hw_surface_free, which leaves the pixels of the parent.
+ */
+surface_t create_surface_view(surface_t surface, const Rect* rect);
+
+/**
+ * \brief   Counters of the blits, see \ref BlitBatch::last_batch.
+ */
+typedef struct {
+    unsigned long blits;        ///< Blits requested.
+    unsigned long groups;       ///< Runs of consecutive blits to one destination with one blend mode,
+                                ///  each submitted with a single setup of the target.
+} blit_stats_t;
+
+/**
+ * \brief   Queues the blits of \ref ei_copy_surface and \ref draw_text between \ref begin and
+ *          \ref end, and submits them together. The other drawing primitives submit the queued
+ *          blits first when they draw over them or into their sources, so the drawing order
+ *          is kept.
+ *          While a batch is open, a source given to \ref ei_copy_surface must not be freed,
+ *          nor changed other than by the drawing functions of this file, before the
+ *          queue is submitted: call \ref submit first.
+ */
+class BlitBatch
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static BlitBatch& getInstance() {
+        static BlitBatch instance;
+        return instance;
+    }
+private:
+    BlitBatch();
+
+public:
+    BlitBatch(BlitBatch const&)       = delete;
+    void operator=(BlitBatch const&)  = delete;
+
+    /**
+     * \brief   Starts queuing the blits.
+     */
+    void begin();
+
+    /**
+     * \brief   Submits the queued blits and stops queuing.
+     */
+    void end();
+
+    /**
+     * \brief   Queues a blit, or submits it at once if no batch is open.
+     *
+     * @param   owned   If EI_TRUE, the source is freed once it has been drawn.
+     */
+    void add(surface_t destination, surface_t source, const Point& where,
+             bool_t use_alpha, bool_t owned);
+
+    /**
+     * \brief   Tells that an area of a surface is about to be drawn: the queued blits that
+     *          draw over it or read from it are submitted first, including through another
+     *          view of the same pixels.
+     */
+    void touch(surface_t surface, const Rect& area);
+
+    /**
+     * \brief   Submits the queued blits.
+     */
+    void submit();
+
+    /**
+     * @return  The counters since \ref begin.
+     */
+    const blit_stats_t& current_batch() const;
+
+    /**
+     * @return  The counters of the last complete batch.
+     */
+    const blit_stats_t& last_batch() const;
+
+private:
+    struct blit_t {
+        surface_t   destination;
+        surface_t   source;
+        Point       where;
+        surface_t   owner;          ///< The surface owning the pixels of the destination, see \ref create_surface_view.
+        Rect        area;           ///< Where the blit draws on the owner.
+        surface_t   source_owner;   ///< The surface owning the pixels of the source.
+        Rect        source_area;    ///< Where the blit reads on the source owner.
+        bool_t      use_alpha;
+        bool_t      owned;
+    };
+
+    bool_t source_is_pending(surface_t surface) const;
+
+    static const size_t k_max_blits = 4096;  ///< The queue is submitted beyond this number of blits.
+    std::vector<blit_t> m_blits;
+    bool_t              m_open;     ///< EI_TRUE between begin and end.
+    blit_stats_t        m_stats;
+    blit_stats_t        m_last;
+};
+
 }
 #endif
@@ -13,7 +13,11 @@
 #include "ei_types.h"
 #include "ei_widget.h"
 
+#ifdef EI_HEADLESS
+#include "hw_keycodes.h"
+#else
 #include <allegro5/keycodes.h>
+#endif
 
 namespace ei {
 
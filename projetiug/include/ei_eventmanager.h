@@ -65,6 +65,32 @@ public:
                  tag_t          tag,
                  ei_callback_t  callback,
                  void*          user_param);
+
+    /**
+     * \brief	Calls the callbacks bound to an event, in the order they were bound, until
+     *          one of them consumes it.
+     *
+     * @param	event		The event.
+     * @param	widget		The widget under the pointer for events that need picking,
+     *                      NULL otherwise: only the callbacks bound to the tag "all" are called.
+     *
+     * @return	EI_TRUE if a callback consumed the event.
+     */
+    bool_t handle (Event* event, Widget* widget);
+
+private:
+    /**
+     * \brief	A callback registered by \ref ei::EventManager::bind.
+     */
+    typedef struct {
+        ei_eventtype_t eventtype;
+        Widget*        widget;
+        tag_t          tag;
+        ei_callback_t  callback;
+        void*          user_param;
+    } binding_t;
+
+    std::vector<binding_t> bindings;
 };
 
 }
@@ -89,6 +89,14 @@ public:
 
     virtual void run (Widget* widget);
 
+private:
+    /**
+     * \brief   Implementation of \ref run, for the widget at some index of the \ref WidgetStore.
+     */
+    void place (int index);
+
+public:
+
     /**
      * \brief Configures the geometry of a widget using the "placer" geometry manager.
      *    If the widget was already managed by another geometry manager, then it is first
@@ -0,0 +1,126 @@
+/**
+ *  @file ei_handle.h
+ *  @brief  Reference counted handles on the surfaces and the fonts of \ref hw_interface.h.
+ *
+ *  A handle adopting a surface frees it when its last copy is destroyed: one decoded image
+ *  can then be shared by any number of widgets without copying its pixels. The handles give
+ *  back the \ref surface_t or \ref font_t of the C-style functions with \ref Handle::get.
+ *
+ */
+
+#ifndef EI_HANDLE_H
+#define EI_HANDLE_H
+
+#include <stddef.h>
+#include <utility>
+
+#include "ei_types.h"
+#include "hw_interface.h"
+
+namespace ei {
+
+/**
+ * \brief   Shared ownership of a resource of the hw layer, released by "Release" with the
+ *          last handle. Copying a handle shares the resource, moving it transfers it.
+ */
+template <void (*Release)(void*)>
+class Handle {
+public:
+    /**
+     * \brief   An empty handle.
+     */
+    Handle()
+        : m_resource(NULL), m_count(NULL)
+    {
+    }
+
+    /**
+     * \brief   Takes the ownership of a resource, which must not be released by the caller.
+     */
+    explicit Handle(void* resource)
+        : m_resource(resource), m_count(resource != NULL ? new long(1) : NULL)
+    {
+    }
+
+    /**
+     * \brief   A handle on a resource owned elsewhere, which is never released by the handles.
+     *          It must outlive them (the root window, \ref ei_default_font).
+     */
+    static Handle borrow(void* resource)
+    {
+        Handle handle;
+        handle.m_resource = resource;
+        return handle;
+    }
+
+    Handle(const Handle& other)
+        : m_resource(other.m_resource), m_count(other.m_count)
+    {
+        if (m_count != NULL)
+            ++*m_count;
+    }
+
+    Handle(Handle&& other)
+        : m_resource(other.m_resource), m_count(other.m_count)
+    {
+        other.m_resource = NULL;
+        other.m_count = NULL;
+    }
+
+    ~Handle()
+    {
+        reset();
+    }
+
+    Handle& operator=(Handle other)
+    {
+        std::swap(m_resource, other.m_resource);
+        std::swap(m_count, other.m_count);
+        return *this;
+    }
+
+    /**
+     * \brief   Releases the resource if this was its last handle, and empties the handle.
+     */
+    void reset()
+    {
+        if (m_count != NULL && --*m_count == 0) {
+            Release(m_resource);
+            delete m_count;
+        }
+        m_resource = NULL;
+        m_count = NULL;
+    }
+
+    /**
+     * @return  The resource, for the C-style functions, or NULL.
+     */
+    void* get() const
+    {
+        return m_resource;
+    }
+
+    bool_t empty() const
+    {
+        return m_resource == NULL ? EI_TRUE : EI_FALSE;
+    }
+
+    /**
+     * @return  The number of handles sharing the resource, 0 if it is borrowed or empty.
+     */
+    long use_count() const
+    {
+        return m_count != NULL ? *m_count : 0;
+    }
+
+private:
+    void*   m_resource;
+    long*   m_count;    ///< Shared by the handles of the resource, NULL if it is not owned.
+};
+
+typedef Handle<hw_surface_free> Surface;      ///< See \ref hw_surface_free.
+typedef Handle<hw_text_font_free> Font;       ///< See \ref hw_text_font_free.
+
+}
+
+#endif
@@ -0,0 +1,110 @@
+/**
+ *  @file ei_hitgrid.h
+ *  @brief  Geometric hit-testing of the widgets, without drawing them in a picking offscreen.
+ *
+ *  The screen is divided in square cells, each listing the widgets whose visible area overlaps
+ *  it. The visible area of a widget is its screen location clipped by the content rectangles of
+ *  its ancestors, as when it is drawn. The grid is updated by the geometry managers when they
+ *  place or unmap a widget. It also keeps the bounding box of every subtree, which lets the
+ *  traversals skip the subtrees out of the rectangle they draw.
+ *
+ */
+
+#ifndef EI_HITGRID_H
+#define EI_HITGRID_H
+
+#include <vector>
+
+#include "ei_types.h"
+#include "ei_widgetstore.h"
+
+namespace ei {
+
+class HitGrid
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static HitGrid& getInstance() {
+        static HitGrid instance;
+        return instance;
+    }
+private:
+    HitGrid();
+
+public:
+    HitGrid(HitGrid const&)   = delete;
+    void operator=(HitGrid const&) = delete;
+
+    static const int k_cell_size = 64;  ///< Side of the cells, in pixels.
+
+    /**
+     * \brief   Updates the visible area of the widget at some index of the \ref WidgetStore,
+     *          after its geometry changed. Its parent must have been updated before, unless it
+     *          is a root: the roots are always shown.
+     *
+     * @return  EI_TRUE if the visible area or the clip of the widget changed, its descendants
+     *          must be updated too.
+     */
+    bool_t update(int index);
+
+    /**
+     * \brief   Removes a widget and its descendants, which are not shown anymore.
+     */
+    void unmap(WidgetStore::handle_t handle);
+
+    /**
+     * \brief   Removes a widget that is destroyed.
+     */
+    void remove(WidgetStore::handle_t handle);
+
+    /**
+     * @return  The widget drawn last at a point of the screen, among a widget and its
+     *          descendants, or NULL. See \ref Widget::contains for the shapes.
+     */
+    Widget* hit(WidgetStore::handle_t handle, const Point& where);
+
+    /**
+     * @return  The bounding box of the visible areas of a widget and its descendants: nothing
+     *          of the subtree is drawn out of it. Computed again after a change of geometry in
+     *          the subtree, when it is asked.
+     */
+    const Rect& bounds(WidgetStore::handle_t handle);
+
+private:
+    typedef struct {
+        Rect    area;       ///< Visible part of the screen location.
+        Rect    clip;       ///< Visible part of the content rectangle, where the children are.
+        bool_t  mapped;     ///< EI_FALSE when the widget is not shown, its rectangles are empty.
+        int     cells[4];   ///< First column, first row, last column, last row of the area.
+        Rect    bounds;     ///< See \ref bounds.
+        bool_t  bounded;    ///< EI_FALSE when the bounds must be computed again.
+    } entry_t;
+
+    entry_t& entry(WidgetStore::handle_t handle);
+
+    /**
+     * \brief   Sets the rectangles of an entry and moves it to the cells of its new area.
+     *
+     * @return  EI_TRUE if the area, the clip or the mapped state changed.
+     */
+    bool_t set(WidgetStore::handle_t handle, bool_t mapped, const Rect& area, const Rect& clip);
+
+    /**
+     * \brief   Marks the bounds of a widget and of its ancestors to be computed again.
+     */
+    void unbound(WidgetStore::handle_t handle);
+
+    void erase_cells(WidgetStore::handle_t handle);
+    void insert_cells(WidgetStore::handle_t handle);
+
+    std::vector<entry_t>                                m_entries;  ///< One per handle.
+    std::vector<std::vector<WidgetStore::handle_t> >    m_cells;    ///< Row by row.
+    int                                                 m_columns;
+    int                                                 m_rows;
+};
+
+}
+
+#endif
@@ -0,0 +1,89 @@
+/**
+ *  @file ei_occlusion.h
+ *  @brief  Occlusion culling: the widgets hidden by opaque widgets drawn after them are not drawn.
+ *
+ *  Before drawing a damaged rectangle, the widgets are walked from the last drawn to the first.
+ *  The opaque areas of the widgets already walked hide the visible area of the current one, see
+ *  \ref Widget::opaque. A widget hidden by widgets drawn after its whole subtree is skipped with
+ *  its descendants; a widget only hidden by its own descendants, such as the background of a
+ *  container, is skipped alone.
+ *
+ */
+
+#ifndef EI_OCCLUSION_H
+#define EI_OCCLUSION_H
+
+#include <vector>
+
+#include "ei_types.h"
+#include "ei_widgetstore.h"
+
+namespace ei {
+
+class OcclusionCuller
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static OcclusionCuller& getInstance() {
+        static OcclusionCuller instance;
+        return instance;
+    }
+private:
+    OcclusionCuller();
+
+public:
+    OcclusionCuller(OcclusionCuller const&)   = delete;
+    void operator=(OcclusionCuller const&) = delete;
+
+    static const int k_max_occluders = 16;  ///< The largest opaque areas kept while walking the widgets.
+
+    /**
+     * \brief   Finds the hidden widgets of a root and its descendants, before drawing them
+     *          within a rectangle of the screen.
+     */
+    void prepare(Widget* root, const Rect& area);
+
+    /**
+     * \brief   Forgets the hidden widgets, once the rectangle is drawn: the widgets are drawn
+     *          entirely until the next \ref prepare.
+     */
+    void finish();
+
+    /**
+     * @return  How much of a widget is hidden in the prepared rectangle.
+     */
+    occlusion_t occluded(const Widget* widget) const;
+
+private:
+    typedef struct {
+        Rect    area;       ///< Opaque part of the visible area.
+        int     index;      ///< Index of the widget in the \ref WidgetStore.
+    } occluder_t;
+
+    typedef struct {
+        Rect    area;       ///< Part of the screen location within the rectangle and the ancestors.
+        int     index;
+    } visible_t;
+
+    /**
+     * \brief   Keeps an opaque area, in place of the smallest one when there are too many.
+     */
+    void add_occluder(const Rect& area, int index);
+
+    /**
+     * @return  EI_TRUE if a rectangle is covered by the occluders of a greater index.
+     */
+    bool_t covered(const Rect& rect, int after) const;
+
+    std::vector<unsigned char>  m_states;       ///< One \ref occlusion_t per index, from m_first.
+    std::vector<Rect>           m_clips;        ///< Where the children of each index are drawn.
+    std::vector<visible_t>      m_visible;      ///< The widgets drawn in the rectangle, in drawing order.
+    std::vector<occluder_t>     m_occluders;
+    int                         m_first;        ///< Index of the prepared root, k_none when finished.
+};
+
+}
+
+#endif
@@ -0,0 +1,268 @@
+/**
+ *  @file ei_raster.h
+ *  @brief  Pixel kernels of the drawing primitives: they fill spans, blend coverage masks and
+ *    copy rows of pixels in memory.
+ *
+ *  The kernels are specialized at compile time on the blend mode and the pixel format, so
+ *  that their inner loops do not branch. A primitive selects the right variant once, with
+ *  \ref select_span_kernel or \ref select_blit_kernel, then calls it for every row.
+ *
+ */
+
+#ifndef EI_RASTER_H
+#define EI_RASTER_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ei_types.h"
+#include "ei_renderstate.h"
+
+namespace ei {
+
+/**
+ * \brief   Divides by 255 with rounding, exact for 0 <= value <= 255 * 255.
+ */
+static inline int div255(int value)
+{
+    value += 128;
+    return (value + (value >> 8)) >> 8;
+}
+
+/**
+ * \brief   The kernels blend 32 bits values holding the channels in the order of \ref color_t,
+ *          red in the low byte. Two channels are processed at once in each half of the value.
+ */
+static inline uint32_t color_to_u32(const color_t& color)
+{
+    uint32_t value;
+    memcpy(&value, &color, sizeof(value));
+    return value;
+}
+
+static inline color_t u32_to_color(uint32_t value)
+{
+    color_t color;
+    memcpy(&color, &value, sizeof(color));
+    return color;
+}
+
+/**
+ * \brief   Multiplies the four channels by factor / 255, with rounding.
+ */
+static inline uint32_t scale_channels(uint32_t value, uint32_t factor)
+{
+    uint32_t rb = (value & 0x00ff00ff) * factor + 0x00800080;
+    uint32_t ga = ((value >> 8) & 0x00ff00ff) * factor + 0x00800080;
+    rb = ((rb + ((rb >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+    ga = (ga + ((ga >> 8) & 0x00ff00ff)) & 0xff00ff00;
+    return rb | ga;
+}
+
+static const uint32_t k_alpha_mask = 0xff000000;
+
+/**
+ * \brief   Pixel formats: they load a pixel as a 32 bits color, and store one back.
+ */
+struct format_rgba8888 {
+    typedef uint32_t pixel_t;
+
+    static inline uint32_t load(pixel_t pixel) { return pixel; }
+    static inline pixel_t store(uint32_t value) { return value; }
+};
+
+struct format_rgbx8888 {
+    typedef uint32_t pixel_t;
+
+    static inline uint32_t load(pixel_t pixel) { return pixel | k_alpha_mask; }
+    static inline pixel_t store(uint32_t value) { return value | k_alpha_mask; }
+};
+
+/**
+ * \brief   A premultiplied white: every channel holds the alpha.
+ */
+struct format_a8 {
+    typedef uint8_t pixel_t;
+
+    static inline uint32_t load(pixel_t pixel) { return pixel * 0x01010101u; }
+    static inline pixel_t store(uint32_t value) { return (pixel_t)(value >> 24); }
+};
+
+/**
+ * @return  The size of a pixel, in bytes.
+ */
+static inline int bytes_per_pixel(surface_format_t format)
+{
+    switch (format) {
+    case ei_format_a8:      return 1;
+    default:                return 4;
+    }
+}
+
+/**
+ * \brief   Blends a color on a pixel.
+ *
+ * @param   Blend   \ref ei_blend_copy replaces the pixel, \ref ei_blend_alpha weights the
+ *                  color by its alpha and makes the pixel opaque (the equation of the polygons),
+ *                  \ref ei_blend_premultiplied adds a color already multiplied by its alpha.
+ */
+template <blend_t Blend>
+static inline uint32_t blend_pixel(uint32_t source, uint32_t target)
+{
+    uint32_t alpha = source >> 24;
+    if (Blend == ei_blend_copy)
+        return source;
+    if (Blend == ei_blend_alpha)
+        return (scale_channels(source, alpha) + scale_channels(target, 255 - alpha)) | k_alpha_mask;
+    return source + scale_channels(target, 255 - alpha);
+}
+
+/**
+ * \brief   The kernels take the address of the first pixel of a row, in the format of the
+ *          surface: a primitive selects them at run time from the format of its surface.
+ */
+typedef void (*span_kernel_t)(void* row, int count, const color_t& color);
+typedef void (*blit_kernel_t)(void* row, const void* source, int count);
+typedef void (*mask_kernel_t)(void* row, const unsigned char* coverage, int count, const color_t& color);
+
+/**
+ * \brief   Fills "count" pixels with a color.
+ */
+template <typename Format, blend_t Blend>
+void span_kernel(void* row, int count, const color_t& color)
+{
+    typename Format::pixel_t* pixels = (typename Format::pixel_t*) row;
+    uint32_t source = color_to_u32(color);
+    if (Blend == ei_blend_copy) {
+        typename Format::pixel_t pixel = Format::store(source);
+        for (int x = 0; x < count; x++)
+            pixels[x] = pixel;
+    } else {
+        for (int x = 0; x < count; x++)
+            pixels[x] = Format::store(blend_pixel<Blend>(source, Format::load(pixels[x])));
+    }
+}
+
+/**
+ * \brief   Copies or blends "count" pixels of a row in the format "Source", converting them.
+ */
+template <typename Format, typename Source, blend_t Blend>
+void blit_kernel(void* row, const void* source, int count)
+{
+    typename Format::pixel_t* pixels = (typename Format::pixel_t*) row;
+    const typename Source::pixel_t* from = (const typename Source::pixel_t*) source;
+    for (int x = 0; x < count; x++)
+        pixels[x] = Format::store(blend_pixel<Blend>(Source::load(from[x]), Format::load(pixels[x])));
+}
+
+/**
+ * \brief   Blends a color on "count" pixels, with its alpha scaled by a coverage mask.
+ */
+template <typename Format>
+void mask_kernel(void* row, const unsigned char* coverage, int count, const color_t& color)
+{
+    typename Format::pixel_t* pixels = (typename Format::pixel_t*) row;
+    // With an opaque alpha, the scaled color holds the scaled alpha: the result is "over".
+    uint32_t opaque = color_to_u32(color) | k_alpha_mask;
+    for (int x = 0; x < count; x++) {
+        uint32_t alpha = div255(color.alpha * coverage[x]);
+        pixels[x] = Format::store(scale_channels(opaque, alpha)
+                                  + scale_channels(Format::load(pixels[x]), 255 - alpha));
+    }
+}
+
+template <typename Format>
+span_kernel_t select_span_kernel(blend_t blend)
+{
+    switch (blend) {
+    case ei_blend_copy:     return span_kernel<Format, ei_blend_copy>;
+    case ei_blend_alpha:    return span_kernel<Format, ei_blend_alpha>;
+    default:                return span_kernel<Format, ei_blend_premultiplied>;
+    }
+}
+
+/**
+ * @return  The span kernel of a pixel format and a blend mode.
+ */
+static inline span_kernel_t select_span_kernel(surface_format_t format, blend_t blend)
+{
+    switch (format) {
+    case ei_format_rgbx8888:    return select_span_kernel<format_rgbx8888>(blend);
+    case ei_format_a8:          return select_span_kernel<format_a8>(blend);
+    default:                    return select_span_kernel<format_rgba8888>(blend);
+    }
+}
+
+template <typename Format, typename Source>
+blit_kernel_t select_blit_kernel(blend_t blend)
+{
+    switch (blend) {
+    case ei_blend_copy:     return blit_kernel<Format, Source, ei_blend_copy>;
+    case ei_blend_alpha:    return blit_kernel<Format, Source, ei_blend_alpha>;
+    default:                return blit_kernel<Format, Source, ei_blend_premultiplied>;
+    }
+}
+
+template <typename Format>
+blit_kernel_t select_blit_kernel(surface_format_t source, blend_t blend)
+{
+    switch (source) {
+    case ei_format_rgbx8888:    return select_blit_kernel<Format, format_rgbx8888>(blend);
+    case ei_format_a8:          return select_blit_kernel<Format, format_a8>(blend);
+    default:                    return select_blit_kernel<Format, format_rgba8888>(blend);
+    }
+}
+
+/**
+ * @return  The blit kernel from a source format to a destination format, with a blend mode.
+ */
+static inline blit_kernel_t select_blit_kernel(surface_format_t format, surface_format_t source,
+                                               blend_t blend)
+{
+    switch (format) {
+    case ei_format_rgbx8888:    return select_blit_kernel<format_rgbx8888>(source, blend);
+    case ei_format_a8:          return select_blit_kernel<format_a8>(source, blend);
+    default:                    return select_blit_kernel<format_rgba8888>(source, blend);
+    }
+}
+
+/**
+ * @return  The mask kernel of a pixel format.
+ */
+static inline mask_kernel_t select_mask_kernel(surface_format_t format)
+{
+    switch (format) {
+    case ei_format_rgbx8888:    return mask_kernel<format_rgbx8888>;
+    case ei_format_a8:          return mask_kernel<format_a8>;
+    default:                    return mask_kernel<format_rgba8888>;
+    }
+}
+
+/**
+ * @return  A pixel of a surface in the given format, as a color.
+ */
+static inline color_t load_pixel(surface_format_t format, const void* pixel)
+{
+    switch (format) {
+    case ei_format_rgbx8888:    return u32_to_color(format_rgbx8888::load(*(const uint32_t*) pixel));
+    case ei_format_a8:          return u32_to_color(format_a8::load(*(const uint8_t*) pixel));
+    default:                    return u32_to_color(format_rgba8888::load(*(const uint32_t*) pixel));
+    }
+}
+
+/**
+ * \brief   Stores a color in a pixel of a surface in the given format.
+ */
+static inline void store_pixel(surface_format_t format, void* pixel, const color_t& color)
+{
+    uint32_t value = color_to_u32(color);
+    switch (format) {
+    case ei_format_rgbx8888:    *(uint32_t*) pixel = format_rgbx8888::store(value);    break;
+    case ei_format_a8:          *(uint8_t*) pixel = format_a8::store(value);           break;
+    default:                    *(uint32_t*) pixel = format_rgba8888::store(value);    break;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ *  @file ei_rendercache.h
+ *  @brief  Retained rendering of the widgets: the pixels of a widget, or of its subtree, are kept
+ *    in an offscreen and blitted back while they are valid, instead of drawing the widget again.
+ *
+ */
+
+#ifndef EI_RENDERCACHE_H
+#define EI_RENDERCACHE_H
+
+#include <stddef.h>
+#include <vector>
+
+#include "ei_types.h"
+#include "ei_widgetstore.h"
+#include "hw_interface.h"
+
+namespace ei {
+
+class IdBuffer;
+
+/**
+ * \brief   Counters of the \ref RenderCache, see \ref Application::render_cache_stats.
+ */
+typedef struct {
+    unsigned long   hits;       ///< Retained widgets drawn by a blit of their offscreen.
+    unsigned long   misses;     ///< Retained widgets drawn from the primitives.
+    unsigned long   evictions;  ///< Offscreens freed to stay within the budget.
+    size_t          bytes;      ///< Memory of the offscreens.
+    size_t          entries;    ///< Number of offscreens.
+} render_cache_stats_t;
+
+/**
+ * \brief   Keeps the offscreens of the retained widgets, see \ref Widget::set_retained.
+ *
+ *          An offscreen is captured when the whole widget is drawn, from the pixels it drew on
+ *          the target. Only the widgets that are opaque on their whole screen location are
+ *          captured, so that nothing drawn under them is kept. An offscreen is dropped when the
+ *          widget, one of its ancestors or, for a subtree, one of its descendants changes.
+ */
+class RenderCache
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static RenderCache& getInstance() {
+        static RenderCache instance;
+        return instance;
+    }
+private:
+    RenderCache();
+
+public:
+    RenderCache(RenderCache const&)   = delete;
+    void operator=(RenderCache const&) = delete;
+
+    static const size_t k_default_budget = 16 << 20;   ///< Default memory of the offscreens, in bytes.
+
+    /**
+     * \brief   Draws a retained widget, from its offscreen if it is valid. The parameters are the
+     *          ones of \ref Widget::draw, the picking buffer is always drawn from the primitives.
+     */
+    void draw(Widget* widget, surface_t surface, IdBuffer* pick_buffer, Rect* clipper);
+
+    /**
+     * \brief   Drops the offscreens that show a widget: its own, the ones of its ancestors that
+     *          keep their subtree, and the ones of its descendants, captured over it.
+     */
+    void invalidate(Widget* widget);
+
+    /**
+     * \brief   Frees the offscreen of a widget that is destroyed or not retained anymore.
+     */
+    void remove(WidgetStore::handle_t handle);
+
+    /**
+     * \brief   Frees the dropped offscreens, and the least recently used ones beyond the budget.
+     *          Must be called out of a \ref BlitBatch, which may still read them.
+     */
+    void trim();
+
+    void set_budget(size_t bytes);
+    size_t budget() const;
+
+    const render_cache_stats_t& stats() const;
+
+    /**
+     * @return  EI_TRUE while the offscreen of a retained widget is drawn, without its children.
+     */
+    bool_t capturing(const Widget* widget) const
+    {
+        return widget == m_capturing ? EI_TRUE : EI_FALSE;
+    }
+
+private:
+    typedef struct {
+        surface_t   surface;    ///< The offscreen, NULL if there is none.
+        Point       where;      ///< Screen location of the widget when it was captured.
+        int         newer;      ///< Handle of the next more recently used offscreen, or k_none.
+        int         older;      ///< Handle of the next less recently used offscreen, or k_none.
+    } entry_t;
+
+    void drop(WidgetStore::handle_t handle);
+    void link(WidgetStore::handle_t handle);
+    void unlink(WidgetStore::handle_t handle);
+
+    std::vector<entry_t>    m_entries;      ///< One per handle.
+    std::vector<surface_t>  m_released;     ///< Offscreens freed by the next \ref trim.
+    const Widget*           m_capturing;
+    int                     m_newest;       ///< Handle of the most recently used offscreen, or k_none.
+    int                     m_oldest;       ///< Handle of the least recently used offscreen, or k_none.
+    size_t                  m_budget;
+    render_cache_stats_t    m_stats;
+};
+
+}
+
+#endif
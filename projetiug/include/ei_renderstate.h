@@ -0,0 +1,110 @@
+/**
+ *  @file ei_renderstate.h
+ *  @brief  Tracks the state of the backend used by the drawing primitives: target surface,
+ *    blend mode and clipping rectangle.
+ *
+ */
+
+#ifndef EI_RENDERSTATE_H
+#define EI_RENDERSTATE_H
+
+#include "ei_types.h"
+#include "hw_interface.h"
+
+namespace ei {
+
+/**
+ * \brief   How the drawn pixels are combined with the pixels of the target.
+ */
+typedef enum {
+    ei_blend_none = 0,      ///< Unknown, the next \ref RenderState::set_blender always sets it.
+    ei_blend_copy,          ///< The drawn pixels replace the target pixels, alpha included.
+    ei_blend_alpha,         ///< The drawn color is weighted by its alpha.
+    ei_blend_premultiplied  ///< The drawn color is already multiplied by its alpha.
+} blend_t;
+
+/**
+ * \brief   Counters of the state changes, see \ref RenderState::last_frame.
+ */
+typedef struct {
+    unsigned long target_changes;   ///< Calls to the backend that changed the target surface.
+    unsigned long target_avoided;   ///< Requested target surfaces that were already set.
+    unsigned long blender_changes;  ///< Calls to the backend that changed the blend mode.
+    unsigned long blender_avoided;  ///< Requested blend modes that were already set.
+    unsigned long clip_changes;     ///< Calls to the backend that changed the clipping rectangle.
+    unsigned long clip_avoided;     ///< Requested clipping rectangles that were already set.
+} render_stats_t;
+
+/**
+ * \brief   Remembers the state of the backend and only calls it when the requested state
+ *          differs. The drawing primitives request the state they need before every
+ *          drawing, and do not restore it.
+ */
+class RenderState
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static RenderState& getInstance() {
+        static RenderState instance;
+        return instance;
+    }
+private:
+    RenderState();
+
+public:
+    RenderState(RenderState const&)   = delete;
+    void operator=(RenderState const&) = delete;
+
+    /**
+     * \brief   Sets the surface on which the backend draws. The clipping rectangle belongs
+     *          to the surface: it must be set again after the target changed.
+     */
+    void set_target(surface_t surface);
+
+    /**
+     * \brief   Sets the blend mode of the backend.
+     */
+    void set_blender(blend_t blender);
+
+    /**
+     * \brief   Restricts the drawing on the target surface.
+     *
+     * @param   clipper     The clipping rectangle, or NULL for the whole target surface.
+     */
+    void set_clip(const Rect* clipper);
+
+    /**
+     * \brief   Forgets the state, after the backend was used without this tracker.
+     */
+    void invalidate();
+
+    /**
+     * \brief   Starts counting the state changes of a new frame.
+     */
+    void begin_frame();
+
+    /**
+     * @return  The state changes of the last complete frame.
+     */
+    const render_stats_t& last_frame() const;
+
+    /**
+     * @return  The state changes since \ref begin_frame.
+     */
+    const render_stats_t& current_frame() const;
+
+private:
+    surface_t       m_target;       ///< Current target, NULL if unknown.
+    blend_t         m_blender;      ///< Current blend mode.
+    bool_t          m_clip_valid;   ///< EI_FALSE if the clipping rectangle of the target is unknown.
+    bool_t          m_clipped;      ///< EI_FALSE if the whole target is drawn.
+    Rect            m_clip;         ///< Clipping rectangle, when m_clipped.
+    render_stats_t  m_current;      ///< Counters of the current frame.
+    render_stats_t  m_last;         ///< Counters of the last frame.
+};
+
+}
+
+#endif
@@ -59,10 +59,8 @@ public:
       y = p.y;
   }
 
-  Point& operator-(const Point &p) {
-      x = -p.x;
-      y = -p.y;
-      return *this;
+  Point operator-() const {
+      return Point(-x, -y);
   }
 
   Point& operator=(Point p) {
@@ -111,6 +109,72 @@ public:
       : top_left(top_left), size(size) {}
 };
 
+/**
+ * @brief Computes the intersection of two rectangles.
+ *
+ * @param r1, r2  The rectangles.
+ * @param result  Where to store the intersection, left unchanged if it is empty.
+ *
+ * @return  EI_FALSE if the rectangles do not overlap.
+ */
+inline bool_t rect_intersection(const Rect& r1, const Rect& r2, Rect* result)
+{
+  int x0 = r1.top_left.x > r2.top_left.x ? r1.top_left.x : r2.top_left.x;
+  int y0 = r1.top_left.y > r2.top_left.y ? r1.top_left.y : r2.top_left.y;
+  int x1 = r1.top_left.x + (int)r1.size.width;
+  int y1 = r1.top_left.y + (int)r1.size.height;
+  if (r2.top_left.x + (int)r2.size.width < x1)
+      x1 = r2.top_left.x + (int)r2.size.width;
+  if (r2.top_left.y + (int)r2.size.height < y1)
+      y1 = r2.top_left.y + (int)r2.size.height;
+  if (x1 <= x0 || y1 <= y0)
+      return EI_FALSE;
+  *result = Rect(Point(x0, y0), Size(x1 - x0, y1 - y0));
+  return EI_TRUE;
+}
+
+/**
+ * @brief Computes the bounding box of two rectangles, an empty rectangle being ignored.
+ */
+inline Rect rect_union(const Rect& r1, const Rect& r2)
+{
+  if (r2.size.width <= 0 || r2.size.height <= 0)
+      return r1;
+  if (r1.size.width <= 0 || r1.size.height <= 0)
+      return r2;
+  int x0 = r1.top_left.x < r2.top_left.x ? r1.top_left.x : r2.top_left.x;
+  int y0 = r1.top_left.y < r2.top_left.y ? r1.top_left.y : r2.top_left.y;
+  int x1 = r1.top_left.x + (int)r1.size.width;
+  int y1 = r1.top_left.y + (int)r1.size.height;
+  if (r2.top_left.x + (int)r2.size.width > x1)
+      x1 = r2.top_left.x + (int)r2.size.width;
+  if (r2.top_left.y + (int)r2.size.height > y1)
+      y1 = r2.top_left.y + (int)r2.size.height;
+  return Rect(Point(x0, y0), Size(x1 - x0, y1 - y0));
+}
+
+/**
+ * @brief Tells if two rectangles have the same position and size.
+ */
+inline bool_t rect_equal(const Rect& r1, const Rect& r2)
+{
+  if (r1.top_left.x != r2.top_left.x || r1.top_left.y != r2.top_left.y
+      || r1.size.width != r2.size.width || r1.size.height != r2.size.height)
+      return EI_FALSE;
+  return EI_TRUE;
+}
+
+/**
+ * @brief Tells if a point is inside a rectangle.
+ */
+inline bool_t rect_contains(const Rect& rect, const Point& point)
+{
+  if (point.x < rect.top_left.x || point.x >= rect.top_left.x + (int)rect.size.width
+      || point.y < rect.top_left.y || point.y >= rect.top_left.y + (int)rect.size.height)
+      return EI_FALSE;
+  return EI_TRUE;
+}
+
 /**
  * @brief A rectangle plus a pointer to create a linked list.
  */
@@ -141,11 +205,30 @@ typedef struct {
                         ///  255 is totally opaque.
 } color_t;
 
+/**
+ * @brief Tells if two colors are the same.
+ */
+inline bool_t color_equal(const color_t& c1, const color_t& c2)
+{
+  if (c1.red != c2.red || c1.green != c2.green || c1.blue != c2.blue || c1.alpha != c2.alpha)
+      return EI_FALSE;
+  return EI_TRUE;
+}
+
 /**
  * @brief The default background color of widgets.
  */
 static const color_t ei_default_background_color = {0xA0, 0xA0, 0xA0, 0xff};
 
+/**
+ * @brief Pixel format of an off-screen surface.
+ */
+typedef enum {
+  ei_format_rgba8888 = 0,  ///< 32 bits with alpha, the format of hw_surface_create.
+  ei_format_rgbx8888,      ///< 32 bits, always opaque.
+  ei_format_a8             ///< 8 bits of alpha only, read as a premultiplied white.
+} surface_format_t;
+
 /**
  * @brief Identifies one particular point of a rectangle.
  */
@@ -171,6 +254,35 @@ typedef enum {
   ei_relief_sunken     ///< Inside the screen.
 } relief_t;
 
+/**
+ * @brief What the offscreen of a retained widget keeps, see \ref Widget::set_retained.
+ */
+typedef enum {
+  ei_retain_none = 0,  ///< Drawn from the primitives.
+  ei_retain_widget,    ///< The widget alone, its children are drawn over it.
+  ei_retain_subtree    ///< The widget and all its descendants.
+} retain_t;
+
+/**
+ * @brief How much of a widget is hidden by the opaque widgets drawn after it, see \ref OcclusionCuller.
+ */
+typedef enum {
+  ei_occluded_none = 0,  ///< Drawn.
+  ei_occluded_widget,    ///< The widget is not drawn, its children are.
+  ei_occluded_subtree    ///< Neither the widget nor its descendants are drawn.
+} occlusion_t;
+
+/**
+ * @brief What a change of the attributes of a widget affects, see \ref Widget::invalidate.
+ *        The values are bits, combined in an int.
+ */
+typedef enum {
+  ei_dirty_none   = 0,       ///< Nothing changed.
+  ei_dirty_paint  = 1 << 0,  ///< Its pixels, and the offscreens of the retained widgets that show them.
+  ei_dirty_pick   = 1 << 1,  ///< Its shape in the picking buffer, and its pixels.
+  ei_dirty_layout = 1 << 2   ///< Its requested size: it is placed again, and drawn where it goes.
+} dirty_t;
+
 /**
  * @brief Set of axis.
  */
@@ -11,6 +11,8 @@
 #define EI_WIDGET_H
 
 #include "ei_draw.h"
+#include "ei_handle.h"
+#include "ei_widgetstore.h"
 
 #include <functional>
 
@@ -55,10 +57,15 @@ public:
      *
      * @param   surface     Where to draw the widget. The actual location of the widget in the
      *                      surface is stored in its "screen_location" field.
+     * @param   pick_buffer Where to draw the widget with its pick id, or NULL when the
+     *                      widgets are picked geometrically (see \ref pick(const Point&)).
      * @param   clipper     If not NULL, the drawing is restricted within this rectangle
      *                      (expressed in the surface reference frame).
+     *
+     * The picking offscreen used to be a surface_t: the derived classes written for it must
+     * take an \ref IdBuffer* now, the overrides are marked so that the compiler catches them.
      */
-    virtual void draw (surface_t surface, surface_t pick_surface, Rect* clipper);
+    virtual void draw (surface_t surface, IdBuffer* pick_buffer, Rect* clipper);
 
     /**
      * \brief   Method that is called to notify the widget that its geometry has been modified
@@ -69,39 +76,126 @@ public:
      */
     virtual void geomnotify (Rect rect);
 
+    /**
+     * @return  The widget of a pick id read from the picking buffer, if it is this widget or
+     *          one of its descendants, NULL otherwise or if it was destroyed. Constant time.
+     */
     Widget* pick(uint32_t id);
     uint32_t getPick_id() const;
 
+    /**
+     * @return  The widget drawn on top at a point of the screen, if it is this widget or one of
+     *          its descendants, NULL otherwise. Uses the \ref HitGrid, without drawing.
+     */
+    Widget* pick(const Point& where);
+
+    /**
+     * \brief   Tells if a point of the screen location is part of the shape of the widget, as
+     *          drawn in the picking buffer. The whole rectangle by default.
+     */
+    virtual bool_t contains(const Point& where) const;
+
+    /**
+     * \brief   Tells if the widget hides what is drawn under it, on some rectangle of the screen.
+     *          Derived from the background: opaque when its color has no transparency and its
+     *          corners are not rounded. See \ref RenderCache and \ref OcclusionCuller. EI_FALSE
+     *          by default.
+     *
+     * @param   area    Where to store the rectangle that the widget covers with opaque pixels.
+     */
+    virtual bool_t opaque(Rect* area) const;
+
     Widget *getParent() const;
 
+    /**
+     * @return  Where the children of this widget are placed.
+     */
+    const Rect* getContent_rect() const;
+
+    /**
+     * @return  The name of the class of this widget, which is also one of its tags.
+     */
+    const widgetclass_name_t& getName() const;
+
+    /**
+     * \brief   Keeps the pixels of the widget, or of its subtree, in an offscreen that is blitted
+     *          instead of drawing them again, until the widget or its descendants change. For
+     *          widgets that rarely change but are costly to draw. See \ref RenderCache.
+     */
+    void set_retained(retain_t retain);
+
 protected:
+    friend class GeometryManager;
+    friend class Placer;
+    friend class RenderCache;
+    friend class OcclusionCuller;
+
+    /**
+     * \brief   Updates what depends on the attributes of the widget after they changed: it is
+     *          placed again only for a layout change, and otherwise redrawn on the next frame
+     *          within its screen location.
+     *
+     * @param   dirty   The \ref dirty_t bits of the changes.
+     */
+    void invalidate(int dirty);
+
+    /**
+     * @return  The index of the widget in the \ref WidgetStore, which changes when widgets
+     *          are created or destroyed.
+     */
+    int index() const;
+
+    /* Accessors to the entry of the widget in the store, valid until a widget is created or destroyed. */
+    Rect&               screen_location();      ///< Position and size of the widget expressed in the root window reference.
+    const Rect&         screen_location() const;
+    Rect&               content_rect();         ///< Where to place children, when this widget is used as a container. By default, the screen_location.
+    placement_t&        placement();            ///< Placer parameters, see \ref Placer::configure.
+    GeometryManager*&   geom_manager();         ///< Geometry manager of this widget.
+                                                ///  If NULL, the widget is not currently managed and thus, is not mapped on the screen.
+
     widgetclass_name_t name; ///< The string name of this class of widget.
 
-    static uint32_t s_idGenerator;
-    uint32_t     pick_id;    ///< Id of this widget in the picking offscreen.
-    color_t   pick_color;    ///< pick_id encoded as a color.
-
-    /* Widget Hierachy Management */
-    Widget*  parent;         ///< Pointer to the parent of this widget.
-    Widget*  children_head;  ///< Pointer to the first child of this widget. Children are chained with the "next_sibling" field.
-    Widget*  children_tail;  ///< Pointer to the last child of this widget.
-    Widget*  next_sibling;   ///< Pointer to the next child of this widget's parent widget.
-
-    /* Geometry Management */
-    GeometryManager* geom_manager; ///< Pointer to the geometry management for this widget.
-                                   ///  If NULL, the widget is not currently managed and thus, is not mapped on the screen.
-    anchor_t   anchor;
-    Point absolute_pos;
-    Size  absolute_size;
-    Point relative_pos;
-    Size  relative_size;
+    uint32_t     pick_id;    ///< Id of this widget in the picking buffer, see \ref WidgetStore::pick_id.
+
+    /* Widget Hierachy Management: the hierarchy and the geometry are kept in the \ref WidgetStore. */
+    WidgetStore::handle_t handle;   ///< Entry of this widget in the store.
+
+    retain_t retained;     ///< See \ref set_retained.
 
     Size  requested_size;  ///< Size requested by the widget (big enough for its label, for example), or by the programmer. This can be different than its screen size defined by the placer.
-    Rect  screen_location; ///< Position and size of the widget expressed in the root window reference.
-    Rect* content_rect;    ///< Where to place children, when this widget is used as a container. By defaults, points to the screen_location.
 };
 
 
+inline int Widget::index() const
+{
+    return WidgetStore::getInstance().index(handle);
+}
+
+inline Rect& Widget::screen_location()
+{
+    return WidgetStore::getInstance().screen_location(index());
+}
+
+inline const Rect& Widget::screen_location() const
+{
+    return WidgetStore::getInstance().screen_location(index());
+}
+
+inline Rect& Widget::content_rect()
+{
+    return WidgetStore::getInstance().content_rect(index());
+}
+
+inline placement_t& Widget::placement()
+{
+    return WidgetStore::getInstance().placement(index());
+}
+
+inline GeometryManager*& Widget::geom_manager()
+{
+    return WidgetStore::getInstance().manager(index());
+}
+
 /**
  * @brief   A function that is called in response to a user event.
  *          Usually passed as a parameter to \ref ei::EventManager::bind.
@@ -129,8 +223,10 @@ public:
     virtual ~Frame();
 
     virtual void draw (surface_t surface,
-                       surface_t pick_surface,
-                       Rect*     clipper);
+                       IdBuffer* pick_buffer,
+                       Rect*     clipper) override;
+
+    virtual bool_t opaque(Rect* area) const;
 
     /**
      * @brief   Configures the attributes of widgets of the class "frame".
@@ -162,7 +258,8 @@ public:
      * @param   img     The image to display in the widget, or NULL. Any surface can be
      *                  used, but usually a surface returned by \ref hw_image_load. Only one
      *                  of the parameter "text" and "img" should be used (i.e. non-NULL).
-     *                  Defaults to NULL.
+     *                  Defaults to NULL. The font and the image remain owned by the caller,
+     *                  see \ref configure_shared to share their ownership with the widget.
      * @param   img_rect    If not NULL, this rectangle defines a subpart of "img" to use as the
      *                      image displayed in the widget. Defaults to NULL.
      * @param   img_anchor  The anchor of the image, i.e. where it is placed whithin the widget
@@ -180,12 +277,75 @@ public:
                     surface_t*      img,
                     Rect**          img_rect,
                     anchor_t*       img_anchor);
+
+    /**
+     * @brief   Like \ref configure, but the widget shares the ownership of the font and of the
+     *          image with the handles: a single surface can be given to any number of widgets
+     *          without copying its pixels, it is freed with the last handle. An empty handle
+     *          stands for NULL.
+     */
+    void configure_shared (Size*           requested_size,
+                           const color_t*  color,
+                           int*            border_width,
+                           relief_t*       relief,
+                           char**          text,
+                           const Font*     text_font,
+                           color_t*        text_color,
+                           anchor_t*       text_anchor,
+                           const Surface*  img,
+                           Rect**          img_rect,
+                           anchor_t*       img_anchor);
+
+protected:
+    /**
+     * @brief   Constructor of the classes of widgets derived from frames.
+     */
+    Frame(const widgetclass_name_t& class_name, Widget* parent);
+
+    /**
+     * @brief   Implementation of \ref configure, shared with the derived classes.
+     *
+     * @param   dirty   The \ref dirty_t flags of the attributes of the derived class that
+     *                  changed: the widget is invalidated once for all the changes.
+     */
+    void configure_frame (Size*              requested_size,
+                          const color_t*     color,
+                          int*               border_width,
+                          relief_t*          relief,
+                          const char* const* text,
+                          const Font*        text_font,
+                          color_t*           text_color,
+                          anchor_t*          text_anchor,
+                          const Surface*     img,
+                          Rect**             img_rect,
+                          anchor_t*          img_anchor,
+                          int                dirty = ei_dirty_none);
+
+    /**
+     * @brief   Draws the text or the image of the frame.
+     *
+     * @param   inner   The rectangle inside the border, where the content is anchored.
+     * @param   clip    The drawing is restricted within this rectangle.
+     */
+    void draw_content (surface_t surface, const Rect& inner, const Rect& clip);
+
+    color_t     color;          ///< Background color.
+    int         border_width;   ///< Width of the relief decoration, in pixels.
+    relief_t    relief;         ///< Appearance of the border.
+    std::string text;           ///< Displayed text, empty when there is none.
+    Font        text_font;      ///< Font of the text, empty for \ref ei_default_font.
+    color_t     text_color;     ///< Color of the text.
+    anchor_t    text_anchor;    ///< Where the text is placed inside the frame.
+    Surface     img;            ///< Displayed image, or empty.
+    Rect*       img_rect;       ///< Part of the image to display, NULL for the whole image.
+    anchor_t    img_anchor;     ///< Where the image is placed inside the frame.
+    bool_t      size_requested; ///< EI_TRUE once a requested size was configured, the natural size is used until then.
 };
 
 
 struct MouseEvent;
 
-class Button : public Widget
+class Button : public Frame
 {
 public:
 
@@ -194,8 +354,12 @@ public:
     virtual ~Button();
 
     virtual void draw (surface_t surface,
-                       surface_t pick_surface,
-                       Rect*     clipper);
+                       IdBuffer* pick_buffer,
+                       Rect*     clipper) override;
+
+    virtual bool_t contains(const Point& where) const;
+
+    virtual bool_t opaque(Rect* area) const;
 
     /**
      * @brief   Configures the attributes of widgets of the class "button".
@@ -224,6 +388,31 @@ public:
                     surface_t*       img,
                     Rect**           img_rect,
                     anchor_t*        img_anchor);
+
+    /**
+     * @brief   Like \ref configure, but the widget shares the ownership of the font and of the
+     *          image with the handles, see \ref Frame::configure_shared.
+     */
+    void configure_shared (Size*            requested_size,
+                           const color_t*   color,
+                           int*             border_width,
+                           int*             corner_radius,
+                           relief_t*        relief,
+                           const char **    text,
+                           const Font*      text_font,
+                           color_t*         text_color,
+                           anchor_t*        text_anchor,
+                           const Surface*   img,
+                           Rect**           img_rect,
+                           anchor_t*        img_anchor);
+
+protected:
+    int         corner_radius;  ///< Radius of the rounded corners, in pixels.
+    bool_t      pressed;        ///< EI_TRUE while the mouse button pressed on the button is down.
+
+private:
+    static bool_t on_buttondown(Widget* widget, Event* event, void* user_param);
+    static bool_t on_buttonup(Widget* widget, Event* event, void* user_param);
 };
 
 
@@ -236,8 +425,8 @@ public:
     virtual ~Toplevel();
 
     virtual void draw (surface_t surface,
-                       surface_t pick_surface,
-                       Rect*     clipper);
+                       IdBuffer* pick_buffer,
+                       Rect*     clipper) override;
 
     /**
      * @brief   Configures the attributes of widgets of the class "toplevel".
@@ -264,6 +453,42 @@ public:
                     bool_t*         closable,
                     axis_set_t*     resizable,
                     Size*           min_size);
+
+    virtual void geomnotify (Rect rect);
+
+    virtual bool_t contains(const Point& where) const;
+
+    virtual bool_t opaque(Rect* area) const;
+
+protected:
+    /**
+     * @brief   What the user is doing with the mouse on the decorations.
+     */
+    typedef enum {
+        ei_action_none = 0,
+        ei_action_move,     ///< Dragging the title bar.
+        ei_action_resize,   ///< Dragging the resize handle.
+        ei_action_close     ///< Pressing the close button.
+    } action_t;
+
+    color_t     color;          ///< Background color of the content.
+    int         border_width;   ///< Width of the border around the content, in pixels.
+    std::string title;          ///< Text of the title bar.
+    bool_t      closable;       ///< EI_TRUE if the title bar has a close button.
+    axis_set_t  resizable;      ///< Axis along which the user can resize the toplevel.
+    Size        min_size;       ///< Minimal size of the content.
+    int         title_height;   ///< Height of the title bar, given by the font.
+    action_t    action;         ///< Current action of the user.
+    Point       grab;           ///< Last position of the mouse during the action.
+
+private:
+    Point close_center() const;
+    int close_radius() const;
+    Rect resize_handle() const;
+
+    static bool_t on_buttondown(Widget* widget, Event* event, void* user_param);
+    static bool_t on_buttonup(Widget* widget, Event* event, void* user_param);
+    static bool_t on_mousemove(Widget* widget, Event* event, void* user_param);
 };
 
 }
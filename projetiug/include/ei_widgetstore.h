@@ -0,0 +1,194 @@
+/**
+ *  @file ei_widgetstore.h
+ *  @brief  Contiguous storage of the hierarchy and the geometry of the widgets.
+ *
+ *  The widgets of all the trees are stored in arrays sorted in depth-first order: the
+ *  descendants of a widget are the entries that follow it, up to the end of its subtree.
+ *  The traversals (drawing, layout, picking) are then forward scans of these arrays, the
+ *  objects of the widgets being only reached for their virtual methods.
+ *
+ *  The widgets are appended when they are created: building a tree breadth-first leaves the
+ *  store out of order, which is restored once, by \ref WidgetStore::order, before the next
+ *  traversal of a subtree that changed.
+ *
+ */
+
+#ifndef EI_WIDGETSTORE_H
+#define EI_WIDGETSTORE_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "ei_types.h"
+
+namespace ei {
+
+class Widget;
+class GeometryManager;
+
+/**
+ * \brief   Parameters of the placer, see \ref Placer::configure.
+ */
+typedef struct {
+    anchor_t    anchor;
+    Point       absolute_pos;   ///< x, y.
+    Size        absolute_size;  ///< width, height, negative when not given.
+    Size        relative_pos;   ///< rel_x, rel_y.
+    Size        relative_size;  ///< rel_width, rel_height.
+} placement_t;
+
+class WidgetStore
+{
+public:
+    /**
+     * @return the singleton instance
+     */
+    static WidgetStore& getInstance() {
+        static WidgetStore instance;
+        return instance;
+    }
+private:
+    WidgetStore();
+
+public:
+    WidgetStore(WidgetStore const&)   = delete;
+    void operator=(WidgetStore const&) = delete;
+
+    /**
+     * \brief   A widget in the store. Unlike its index, it does not change when the entries
+     *          are moved.
+     */
+    typedef uint32_t handle_t;
+
+    static const int k_none = -1;   ///< Index or handle of the parent of a root.
+
+    /* A pick id is a handle in its low 20 bits, and the generation of the handle in the 12 bits
+       above: the id of a destroyed widget does not resolve to the widgets given the same handle
+       during the next 4095 reuses. The ids are written as they are in the \ref IdBuffer. */
+    static const int        k_pick_handle_bits = 20;
+    static const uint32_t   k_pick_handle_mask = (1u << k_pick_handle_bits) - 1;
+    static const uint32_t   k_pick_generation_mask = 0xffffffffu >> k_pick_handle_bits;
+    static const uint32_t   k_no_pick_id = 0xffffffffu;    ///< Id of the widgets beyond the handles of the ids, never resolved.
+
+    /**
+     * \brief   Adds a widget as the last child of its parent, or as a new root.
+     *
+     * @param   parent  The handle of the parent, ignored if "root" is EI_TRUE.
+     */
+    handle_t insert(Widget* widget, handle_t parent, bool_t root);
+
+    /**
+     * \brief   Removes a widget, whose descendants must have been removed already.
+     */
+    void remove(handle_t handle);
+
+    /**
+     * \brief   Restores the depth-first order if the subtree of a widget is not contiguous
+     *          anymore. Must be called before visiting the children with \ref end, and before
+     *          taking the indices used by the visit: they change when the entries are sorted.
+     */
+    void order(handle_t handle)
+    {
+        if (m_ordered == EI_FALSE && m_first_children[handle] != k_none)
+            sort();
+    }
+
+    /**
+     * @return  The handle of the first child of a widget, k_none if it has no children.
+     */
+    int first_child(handle_t handle) const  { return m_first_children[handle]; }
+
+    /**
+     * @return  The handle of the next sibling of a widget, k_none for the last child.
+     */
+    int next_sibling(handle_t handle) const { return m_next_siblings[handle]; }
+
+    /**
+     * @return  The handle of the parent of a widget, k_none for a root.
+     */
+    int parent_handle(handle_t handle) const { return m_parent_handles[handle]; }
+
+    /**
+     * @return  The current index of a widget in the arrays.
+     */
+    int index(handle_t handle) const        { return m_indices[handle]; }
+
+    /**
+     * @return  The number of entries, including the removed ones not dropped yet.
+     */
+    int size() const                        { return (int)m_widgets.size(); }
+
+    /**
+     * @return  The widget of an entry, NULL if it was removed.
+     */
+    Widget* widget(int index) const         { return m_widgets[index]; }
+    handle_t handle(int index) const        { return m_handles[index]; }
+
+    /**
+     * @return  The index following the last descendant of an entry. The children of the entry
+     *          at "index" are visited by: for (i = index + 1; i < end(index); i = end(i)).
+     */
+    int end(int index) const                { return m_ends[index]; }
+
+    int parent(int index) const             { return m_parents[index]; }
+
+    Rect& screen_location(int index)        { return m_screen_locations[index]; }
+    Rect& content_rect(int index)           { return m_content_rects[index]; }
+    placement_t& placement(int index)       { return m_placements[index]; }
+    GeometryManager*& manager(int index)    { return m_managers[index]; }
+
+    /**
+     * @return  The pick id of a widget, see \ref k_pick_handle_bits.
+     */
+    uint32_t pick_id(handle_t handle) const
+    {
+        if (handle >= k_pick_handle_mask)
+            return k_no_pick_id;
+        return handle | (m_generations[handle] & k_pick_generation_mask) << k_pick_handle_bits;
+    }
+
+    /**
+     * @return  The widget of a pick id, or NULL if it was destroyed.
+     */
+    Widget* resolve(uint32_t pick_id) const
+    {
+        handle_t handle = pick_id & k_pick_handle_mask;
+        if (pick_id == k_no_pick_id || handle >= m_indices.size() || m_indices[handle] == k_none
+            || ((m_generations[handle] & k_pick_generation_mask) << k_pick_handle_bits) != (pick_id & ~k_pick_handle_mask))
+            return NULL;
+        return m_widgets[m_indices[handle]];
+    }
+
+private:
+    /**
+     * \brief   Sorts the entries in depth-first order and drops the removed ones.
+     */
+    void sort();
+
+    // One entry per widget, in depth-first order.
+    std::vector<Widget*>            m_widgets;
+    std::vector<handle_t>           m_handles;
+    std::vector<int>                m_parents;
+    std::vector<int>                m_ends;
+    std::vector<Rect>               m_screen_locations;
+    std::vector<Rect>               m_content_rects;
+    std::vector<GeometryManager*>   m_managers;
+    std::vector<placement_t>        m_placements;
+
+    // One entry per handle, the links are handles.
+    std::vector<int>                m_indices;      ///< Index of every handle, k_none when free.
+    std::vector<uint32_t>           m_generations;  ///< Number of times every handle was freed.
+    std::vector<int>                m_parent_handles;
+    std::vector<int>                m_first_children;
+    std::vector<int>                m_last_children;
+    std::vector<int>                m_next_siblings;
+    std::vector<int>                m_previous_siblings;
+
+    std::vector<handle_t>           m_free_handles;
+    int                             m_removed;      ///< Number of removed entries not dropped.
+    bool_t                          m_ordered;      ///< EI_FALSE when a subtree is not contiguous.
+};
+
+}
+
+#endif
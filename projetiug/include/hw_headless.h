@@ -0,0 +1,97 @@
+/**
+ * @file  hw_headless.h
+ *
+ * @brief In-memory implementation of \ref hw_interface.h, selected by configuring the
+ *        project with EI_HEADLESS=ON. It replaces libeibase so that programs run without
+ *        a display: surfaces are plain arrays of \ref ei::color_t, text is rasterized from
+ *        the TrueType file, and \ref hw_event_wait_next reads events from a script.
+ *
+ *        The script is either filled programmatically with \ref hw_headless_push_event,
+ *        or loaded by \ref hw_init from the file named by the EI_HEADLESS_SCRIPT
+ *        environment variable. It contains one event per line, '#' starts a comment:
+ *
+ *        <pre>
+ *          keydown   key_sym [modifier_mask]
+ *          keyup     key_sym [modifier_mask]
+ *          keychar   unichar
+ *          mousedown x y button
+ *          mouseup   x y button
+ *          mousemove x y
+ *          display   closed|resized|switched_in|switched_out
+ *          app
+ *        </pre>
+ *
+ *        \ref hw_create_window may be called again: the window is cleared and resized to the
+ *        requested size, its surface stays the same. A full screen window is 1920x1080.
+ *
+ *        Once the script is exhausted, \ref hw_event_wait_next returns an "Escape" key
+ *        press followed by "window closed" display events, so that every program of the
+ *        test set eventually terminates.
+ */
+
+#ifndef HW_HEADLESS_H
+#define HW_HEADLESS_H
+
+#include "hw_interface.h"
+
+/**
+ * @brief Appends an event at the end of the scripted event queue.
+ *
+ * @param   event   The event, allocated with new. The queue takes its ownership,
+ *                  it is handed to the caller of \ref hw_event_wait_next.
+ */
+void hw_headless_push_event(ei::Event* event);
+
+/**
+ * @brief Appends the events described in a script file to the event queue.
+ *
+ * @param   filename    The path to the script (see the format above).
+ *
+ * @return  EI_FALSE if the file could not be read or contains an invalid line.
+ */
+ei::bool_t hw_headless_load_script(const char* filename);
+
+/**
+ * @brief Allocates an off-screen surface in a given pixel format, see \ref hw_surface_create.
+ *
+ * @param   size      Number of horizontal and vertical pixels.
+ * @param   format    The pixel format.
+ *
+ * @return  The surface, to be freed by calling \ref hw_surface_free.
+ */
+surface_t hw_headless_surface_create(const ei::Size* size, ei::surface_format_t format);
+
+/**
+ * @brief Creates a view sharing the pixels of a rectangle of a surface.
+ *
+ * @param   surface   The parent surface.
+ * @param   rect      The rectangle of the view, inside the parent surface.
+ *
+ * @return  The view, to be freed by calling \ref hw_surface_free before its parent.
+ */
+surface_t hw_headless_surface_create_view(const surface_t surface, const ei::Rect* rect);
+
+/**
+ * @brief Returns the surface owning the pixels of a view, or the surface itself.
+ *
+ * @param   surface   The surface.
+ * @param   origin    Where to store the position of the surface in its owner.
+ */
+surface_t hw_headless_get_owner(const surface_t surface, ei::Point* origin);
+
+/**
+ * @brief Returns the pixel format of a surface.
+ */
+ei::surface_format_t hw_headless_get_format(const surface_t surface);
+
+/**
+ * @brief Gives direct access to the pixels of a surface, in its pixel format.
+ *
+ * @param   surface   The surface.
+ * @param   pitch     Where to store the number of bytes between two consecutive rows.
+ *
+ * @return  The address of the top-left pixel of the surface.
+ */
+void* hw_headless_get_data(const surface_t surface, int* pitch);
+
+#endif
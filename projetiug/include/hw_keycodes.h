@@ -0,0 +1,114 @@
+/**
+ * @file  hw_keycodes.h
+ *
+ * @brief The key symbols of \ref ei::KeyEvent when the project is configured with
+ *        EI_HEADLESS=ON, which does not need Allegro: the names and values of
+ *        allegro5/keycodes.h, for the keys of a common keyboard.
+ */
+
+#ifndef HW_KEYCODES_H
+#define HW_KEYCODES_H
+
+enum {
+    ALLEGRO_KEY_A = 1,
+    ALLEGRO_KEY_B,
+    ALLEGRO_KEY_C,
+    ALLEGRO_KEY_D,
+    ALLEGRO_KEY_E,
+    ALLEGRO_KEY_F,
+    ALLEGRO_KEY_G,
+    ALLEGRO_KEY_H,
+    ALLEGRO_KEY_I,
+    ALLEGRO_KEY_J,
+    ALLEGRO_KEY_K,
+    ALLEGRO_KEY_L,
+    ALLEGRO_KEY_M,
+    ALLEGRO_KEY_N,
+    ALLEGRO_KEY_O,
+    ALLEGRO_KEY_P,
+    ALLEGRO_KEY_Q,
+    ALLEGRO_KEY_R,
+    ALLEGRO_KEY_S,
+    ALLEGRO_KEY_T,
+    ALLEGRO_KEY_U,
+    ALLEGRO_KEY_V,
+    ALLEGRO_KEY_W,
+    ALLEGRO_KEY_X,
+    ALLEGRO_KEY_Y,
+    ALLEGRO_KEY_Z,
+    ALLEGRO_KEY_0 = 27,
+    ALLEGRO_KEY_1,
+    ALLEGRO_KEY_2,
+    ALLEGRO_KEY_3,
+    ALLEGRO_KEY_4,
+    ALLEGRO_KEY_5,
+    ALLEGRO_KEY_6,
+    ALLEGRO_KEY_7,
+    ALLEGRO_KEY_8,
+    ALLEGRO_KEY_9,
+    ALLEGRO_KEY_PAD_0 = 37,
+    ALLEGRO_KEY_PAD_1,
+    ALLEGRO_KEY_PAD_2,
+    ALLEGRO_KEY_PAD_3,
+    ALLEGRO_KEY_PAD_4,
+    ALLEGRO_KEY_PAD_5,
+    ALLEGRO_KEY_PAD_6,
+    ALLEGRO_KEY_PAD_7,
+    ALLEGRO_KEY_PAD_8,
+    ALLEGRO_KEY_PAD_9,
+    ALLEGRO_KEY_F1 = 47,
+    ALLEGRO_KEY_F2,
+    ALLEGRO_KEY_F3,
+    ALLEGRO_KEY_F4,
+    ALLEGRO_KEY_F5,
+    ALLEGRO_KEY_F6,
+    ALLEGRO_KEY_F7,
+    ALLEGRO_KEY_F8,
+    ALLEGRO_KEY_F9,
+    ALLEGRO_KEY_F10,
+    ALLEGRO_KEY_F11,
+    ALLEGRO_KEY_F12,
+    ALLEGRO_KEY_ESCAPE = 59,
+    ALLEGRO_KEY_TILDE,
+    ALLEGRO_KEY_MINUS,
+    ALLEGRO_KEY_EQUALS,
+    ALLEGRO_KEY_BACKSPACE,
+    ALLEGRO_KEY_TAB,
+    ALLEGRO_KEY_OPENBRACE,
+    ALLEGRO_KEY_CLOSEBRACE,
+    ALLEGRO_KEY_ENTER,
+    ALLEGRO_KEY_SEMICOLON,
+    ALLEGRO_KEY_QUOTE,
+    ALLEGRO_KEY_BACKSLASH,
+    ALLEGRO_KEY_BACKSLASH2,
+    ALLEGRO_KEY_COMMA,
+    ALLEGRO_KEY_FULLSTOP,
+    ALLEGRO_KEY_SLASH,
+    ALLEGRO_KEY_SPACE,
+    ALLEGRO_KEY_INSERT,
+    ALLEGRO_KEY_DELETE,
+    ALLEGRO_KEY_HOME,
+    ALLEGRO_KEY_END,
+    ALLEGRO_KEY_PGUP,
+    ALLEGRO_KEY_PGDN,
+    ALLEGRO_KEY_LEFT,
+    ALLEGRO_KEY_RIGHT,
+    ALLEGRO_KEY_UP,
+    ALLEGRO_KEY_DOWN,
+    ALLEGRO_KEY_LSHIFT = 215,
+    ALLEGRO_KEY_RSHIFT,
+    ALLEGRO_KEY_LCTRL,
+    ALLEGRO_KEY_RCTRL,
+    ALLEGRO_KEY_ALT,
+    ALLEGRO_KEY_ALTGR,
+    ALLEGRO_KEY_LWIN,
+    ALLEGRO_KEY_RWIN,
+    ALLEGRO_KEY_MENU,
+    ALLEGRO_KEY_SCROLLLOCK,
+    ALLEGRO_KEY_NUMLOCK,
+    ALLEGRO_KEY_CAPSLOCK,
+
+    ALLEGRO_KEY_MAX
+};
+
+#endif
@@ -4,41 +4,179 @@
 #include "ei_eventmanager.h"
 #include "hw_interface.h"
 #include "ei_application.h"
-
-#include <allegro5/allegro5.h>
-#include <allegro5/allegro_primitives.h>
+#include "ei_renderstate.h"
+#include "ei_occlusion.h"
+#include "ei_configurebatch.h"
 
 namespace ei {
-Application::Application(Size* main_window_size, bool_t fullscreen){
+
+Application* Application::s_instance = NULL;
+
+Application::Application(Size* main_window_size, bool_t fullscreen)
+    : m_quit(EI_FALSE)
+{
+    s_instance = this;
 
     hw_init();         //initialisation
 
-    hw_create_window(main_window_size,fullscreen);    //create windows
+    m_root_surface = hw_create_window(main_window_size, fullscreen);    //create windows
 
-   // A COMPLETER
+    Size size = hw_surface_get_size(m_root_surface);
+    m_pick_buffer = NULL;
+
+    m_root_widget = new Frame(NULL);
+    m_root_widget->geomnotify(Rect(Point(0, 0), size));
+    invalidate_rect(Rect(Point(0, 0), size));
 }
 
 Application::~Application(){
 
+    delete m_root_widget;
+    RenderCache::getInstance().trim();
+    delete m_pick_buffer;
+    MaskCache::getInstance().clear();
+    s_instance = NULL;
+
     hw_quit();
 }
 
+void Application::run()
+{
+    while (m_quit == EI_FALSE) {
+        redraw();
+
+        Event* event = hw_event_wait_next();
+
+        // Mouse and touch events are sent to the widget under the pointer.
+        Widget* widget = NULL;
+        if (event->type >= ei_ev_mouse_buttondown && event->type < ei_ev_last) {
+            Point where = event->type <= ei_ev_mouse_move ? static_cast<MouseEvent*>(event)->where
+                                                          : static_cast<TouchEvent*>(event)->where;
+            if (m_pick_buffer != NULL) {
+                widget = m_root_widget->pick(m_pick_buffer->at(where));
+            } else {
+                widget = m_root_widget->pick(where);
+            }
+        }
+
+        bool_t consumed = EventManager::getInstance().handle(event, widget);
+
+        // Closing the window quits, unless a callback handled it.
+        if (consumed == EI_FALSE && event->type == ei_ev_display
+                && static_cast<DisplayEvent*>(event)->closed == EI_TRUE)
+            m_quit = EI_TRUE;
+
+        delete event;
+    }
+}
+
+void Application::redraw()
+{
+    if (m_invalidated.empty() && m_pick_invalidated.empty())
+        return;
+
+    RenderState::getInstance().begin_frame();
+    BlitBatch::getInstance().begin();
+
+    // The picking buffer is only drawn where the geometry changed.
+    OcclusionCuller& culler = OcclusionCuller::getInstance();
+    size_t count = m_pick_invalidated.size() + m_invalidated.size();
+    linked_rect_t* rects = new linked_rect_t[count];
+    for (size_t i = 0; i < count; i++) {
+        bool_t pick = i < m_pick_invalidated.size() ? EI_TRUE : EI_FALSE;
+        rects[i].rect = pick == EI_TRUE ? m_pick_invalidated[i] : m_invalidated[i - m_pick_invalidated.size()];
+        rects[i].next = i + 1 < count ? &rects[i + 1] : NULL;
+        IdBuffer* pick_buffer = pick == EI_TRUE ? m_pick_buffer : NULL;
+
+        // The widgets hidden by opaque widgets drawn after them are skipped.
+        culler.prepare(m_root_widget, rects[i].rect);
+        if (culler.occluded(m_root_widget) == ei_occluded_widget)
+            m_root_widget->Widget::draw(m_root_surface, pick_buffer, &rects[i].rect);
+        else
+            m_root_widget->draw(m_root_surface, pick_buffer, &rects[i].rect);
+        culler.finish();
+    }
+    BlitBatch::getInstance().end();
+    MaskCache::getInstance().trim();
+    RenderCache::getInstance().trim();
+    hw_surface_update_rects(rects);
+
+    delete[] rects;
+    m_invalidated.clear();
+    m_pick_invalidated.clear();
+}
+
+void Application::invalidate_rect(const Rect &rect)
+{
+    Rect visible;
+    if (rect_intersection(rect, hw_surface_get_rect(m_root_surface), &visible) == EI_TRUE
+            && ConfigureBatch::getInstance().defer_invalidate(visible, EI_FALSE) == EI_FALSE)
+        m_invalidated.push_back(visible);
+}
+
+void Application::invalidate_geometry(const Rect &rect)
+{
+    Rect visible;
+    if (rect_intersection(rect, hw_surface_get_rect(m_root_surface), &visible) == EI_TRUE
+            && ConfigureBatch::getInstance().defer_invalidate(visible, EI_TRUE) == EI_FALSE)
+        m_pick_invalidated.push_back(visible);
+}
 
-void run(){
+void Application::use_pick_buffer(bool_t enabled, bool_t half_resolution)
+{
+    delete m_pick_buffer;
+    m_pick_buffer = NULL;
 
-    //A COMPLETER
+    if (enabled == EI_TRUE) {
+        m_pick_buffer = new IdBuffer();
+        m_pick_buffer->resize(hw_surface_get_size(m_root_surface), half_resolution);
+        invalidate_geometry(hw_surface_get_rect(m_root_surface));
+    }
 }
 
+void Application::set_render_cache_budget(size_t bytes)
+{
+    RenderCache::getInstance().set_budget(bytes);
+}
 
-void invalidate_rect(const Rect &rect);
+const render_cache_stats_t& Application::render_cache_stats() const
+{
+    return RenderCache::getInstance().stats();
+}
 
+void Application::quit_request()
+{
+    m_quit = EI_TRUE;
+}
 
-void quit_request();
+IdBuffer* Application::pick_buffer()
+{
+    return m_pick_buffer;
+}
 
+const std::vector<Rect>& Application::invalidated_rects() const
+{
+    return m_invalidated;
+}
 
-Frame* root_widget();
+const std::vector<Rect>& Application::invalidated_geometry() const
+{
+    return m_pick_invalidated;
+}
 
-surface_t root_surface();
+Frame* Application::root_widget()
+{
+    return m_root_widget;
+}
 
+surface_t Application::root_surface()
+{
+    return m_root_surface;
+}
+
+Application* Application::getInstance()
+{
+    return s_instance;
+}
 
 }
@@ -0,0 +1,119 @@
+#include "ei_configurebatch.h"
+#include "ei_application.h"
+#include "ei_geometrymanager.h"
+
+namespace ei {
+
+const int ConfigureBatch::k_max_rects;
+
+ConfigureBatch::ConfigureBatch()
+    : m_depth(0), m_committing(EI_FALSE)
+{
+}
+
+void ConfigureBatch::begin()
+{
+    m_depth++;
+}
+
+void ConfigureBatch::commit()
+{
+    if (m_depth == 0 || --m_depth > 0)
+        return;
+
+    // The widgets are placed with their ancestors when those changed too, the damaged areas
+    // they invalidate are still merged.
+    m_depth = 1;
+    m_committing = EI_TRUE;
+    WidgetStore& store = WidgetStore::getInstance();
+    for (size_t i = 0; i < m_pending.size(); i++) {
+        WidgetStore::handle_t handle = m_pending[i];
+        if (m_marked[handle] == EI_FALSE)
+            continue;
+        // An ancestor only places its descendants while it is managed: the subtrees of the
+        // widgets without a geometry manager are skipped.
+        bool_t placed = EI_FALSE;
+        for (int parent = store.parent_handle(handle); parent != WidgetStore::k_none && placed == EI_FALSE;
+             parent = store.parent_handle(parent)) {
+            if (store.manager(store.index(parent)) == NULL)
+                break;
+            placed = (size_t)parent < m_marked.size() ? m_marked[parent] : EI_FALSE;
+        }
+        int index = store.index(handle);
+        if (placed == EI_FALSE && store.manager(index) != NULL)
+            store.manager(index)->run(store.widget(index));
+    }
+    for (size_t i = 0; i < m_pending.size(); i++)
+        m_marked[m_pending[i]] = EI_FALSE;
+    m_pending.clear();
+    m_committing = EI_FALSE;
+    m_depth = 0;
+
+    Application* app = Application::getInstance();
+    for (size_t i = 0; app != NULL && i < m_invalidated.size(); i++)
+        app->invalidate_rect(m_invalidated[i]);
+    for (size_t i = 0; app != NULL && i < m_pick_invalidated.size(); i++)
+        app->invalidate_geometry(m_pick_invalidated[i]);
+    m_invalidated.clear();
+    m_pick_invalidated.clear();
+}
+
+bool_t ConfigureBatch::open() const
+{
+    return m_depth > 0 ? EI_TRUE : EI_FALSE;
+}
+
+bool_t ConfigureBatch::defer_run(WidgetStore::handle_t handle)
+{
+    if (m_depth == 0 || m_committing == EI_TRUE)
+        return EI_FALSE;
+    if (handle >= m_marked.size())
+        m_marked.resize(handle + 1, EI_FALSE);
+    if (m_marked[handle] == EI_FALSE) {
+        m_marked[handle] = EI_TRUE;
+        m_pending.push_back(handle);
+    }
+    return EI_TRUE;
+}
+
+bool_t ConfigureBatch::defer_invalidate(const Rect& rect, bool_t geometry)
+{
+    if (m_depth == 0)
+        return EI_FALSE;
+    merge(geometry == EI_TRUE ? m_pick_invalidated : m_invalidated, rect);
+    return EI_TRUE;
+}
+
+void ConfigureBatch::remove(WidgetStore::handle_t handle)
+{
+    if (handle < m_marked.size())
+        m_marked[handle] = EI_FALSE;
+}
+
+void ConfigureBatch::merge(std::vector<Rect>& rects, const Rect& rect)
+{
+    // A merged rectangle may reach other ones: the list is scanned again.
+    Rect merged = rect, overlap;
+    for (size_t i = 0; i < rects.size(); ) {
+        const Rect& other = rects[i];
+        Rect grown(other.top_left - Point(1, 1), other.size + Size(2, 2));
+        if (rect_intersection(grown, merged, &overlap) == EI_TRUE) {
+            merged = rect_union(merged, other);
+            rects[i] = rects.back();
+            rects.pop_back();
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    rects.push_back(merged);
+
+    // Too many rectangles are drawn in one.
+    if ((int)rects.size() > k_max_rects) {
+        for (size_t i = 1; i < rects.size(); i++)
+            rects[0] = rect_union(rects[0], rects[i]);
+        rects.resize(1);
+    }
+}
+
+}
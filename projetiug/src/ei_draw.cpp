@@ -1,11 +1,21 @@
 #include "ei_draw.h"
+#include "ei_renderstate.h"
+#include "ei_raster.h"
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <math.h>
+#include <limits.h>
 
+#include <algorithm>
+
+#ifdef EI_HEADLESS
+#include "hw_headless.h"
+#else
 #include <allegro5/allegro5.h>
 #include <allegro5/allegro_primitives.h>
+#endif
 
 namespace ei {
 
@@ -16,6 +26,8 @@ linked_point_t* arc(const Point& center, float radius, int start_angle, int end_
 
     float angle = (end_angle - start_angle) * M_PI/180.f;
     int nbpts = radius * fabs(angle);
+    if (nbpts < 1)
+        nbpts = 1;
     for(int i=0; i<=nbpts; i++){
         list->next = (linked_point_t*) malloc(sizeof(linked_point_t));
         list = list->next;
@@ -67,8 +79,6 @@ linked_point_t* rounded_frame(Rect *rect, float radius, bt_part part)
     }else{
         list->next = arc(pt, radius, 315, 360);
     }
-
-    list->next = arc(pt, radius, 315, 360);
     while(list->next)
         list = list->next;
     pt.y += (rect->size.height - 2.f * radius);
@@ -93,25 +103,93 @@ linked_point_t* rounded_frame(Rect *rect, float radius, bt_part part)
     return start;
 }
 
+static inline color_t alpha_blend(const color_t in_pixel, const color_t dst_pixel)
+{
+    color_t blended;
+    float alpha = ((float)in_pixel.alpha) / 255.f;
+    blended.red   = (1.f -  alpha) * dst_pixel.red   + alpha * in_pixel.red;
+    blended.green = (1.f -  alpha) * dst_pixel.green + alpha * in_pixel.green;
+    blended.blue  = (1.f -  alpha) * dst_pixel.blue  + alpha * in_pixel.blue;
+    blended.alpha = 255;
+    return blended;
+}
+
 void draw_line(surface_t surface, const Point& start,
                   const Point& end, const color_t& color,
                   const Rect* clipper)
 {
-    al_set_target_bitmap((ALLEGRO_BITMAP*) surface);
-    if(clipper)
-        al_set_clipping_rectangle(clipper->top_left.x, clipper->top_left.y, clipper->size.width, clipper->size.height);
+    Rect area(Point(std::min(start.x, end.x), std::min(start.y, end.y)),
+              Size(abs(end.x - start.x) + 1, abs(end.y - start.y) + 1));
+    if (clipper != NULL && !rect_intersection(area, *clipper, &area))
+        return;
+    BlitBatch::getInstance().touch(surface, area);
+
+    RenderState& state = RenderState::getInstance();
+    state.set_target(surface);
+    state.set_blender(ei_blend_alpha);
+    state.set_clip(clipper);
+
+#ifdef EI_HEADLESS
+    int dx = abs(end.x - start.x), sx = start.x < end.x ? 1 : -1;
+    int dy = -abs(end.y - start.y), sy = start.y < end.y ? 1 : -1;
+    int err = dx + dy;
+    Point pos = start;
+
+    while (true) {
+        if (clipper == NULL ||
+                ((clipper->top_left.x <= pos.x) && (pos.x < clipper->top_left.x + clipper->size.width)
+                 && (clipper->top_left.y <= pos.y) && (pos.y < clipper->top_left.y + clipper->size.height)))
+            hw_put_pixel(surface, pos, alpha_blend(color, hw_get_pixel(surface, pos)));
+        if (pos.x == end.x && pos.y == end.y)
+            break;
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            pos.x += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            pos.y += sy;
+        }
+    }
+#else
     al_draw_line(start.x, start.y, end.x, end.y, al_map_rgba(color.red, color.green, color.blue, color.alpha), 1);
+#endif
 }
 
 void draw_polyline(surface_t surface,
                       const linked_point_t* first_point,
-                      const color_t color, const Rect* clipper)
+                      const color_t color, const Rect* clipper,
+                      bool_t decimated)
 {
     Point start, end;
 
     if (first_point == NULL)
         return;
 
+    if (decimated == EI_TRUE) {
+        // The points of the current column: the segments between them cover [min_y, max_y].
+        // The segments between two columns are drawn as soon as the column changes.
+        Point last = first_point->point;
+        int min_y = last.y, max_y = last.y;
+        for (const linked_point_t* lpoint = first_point->next; lpoint != NULL; lpoint = lpoint->next) {
+            const Point& point = lpoint->point;
+            if (point.x == last.x) {
+                min_y = std::min(min_y, point.y);
+                max_y = std::max(max_y, point.y);
+            } else {
+                if (min_y != max_y)
+                    draw_line(surface, Point(last.x, min_y), Point(last.x, max_y), color, clipper);
+                draw_line(surface, last, point, color, clipper);
+                min_y = max_y = point.y;
+            }
+            last = point;
+        }
+        if (min_y != max_y)
+            draw_line(surface, Point(last.x, min_y), Point(last.x, max_y), color, clipper);
+        return;
+    }
+
     start = first_point->point;
     while (first_point->next != NULL) {
         end = first_point->next->point;
@@ -121,295 +199,1273 @@ void draw_polyline(surface_t surface,
     }
 }
 
-static inline color_t alpha_blend(const color_t in_pixel, const color_t dst_pixel)
+/**
+ * \brief   Initializes the Bresenham walk of an edge from its lower end, for the edge tables
+ *          of \ref Path and \ref draw_polygons.
+ *
+ * @return  false for an horizontal edge, which is not stored.
+ */
+template <typename Edge>
+static inline bool init_edge(const Point& start, const Point& end, Edge& edge)
 {
-    color_t blended;
-    float alpha = ((float)in_pixel.alpha) / 255.f;
-    blended.red   = (1.f -  alpha) * dst_pixel.red   + alpha * in_pixel.red;
-    blended.green = (1.f -  alpha) * dst_pixel.green + alpha * in_pixel.green;
-    blended.blue  = (1.f -  alpha) * dst_pixel.blue  + alpha * in_pixel.blue;
-    blended.alpha = 255;
-    return blended;
+    if (start.y == end.y)
+        return false;
+    const Point& low  = start.y < end.y ? start : end;
+    const Point& high = start.y < end.y ? end : start;
+    edge.y_min = low.y;
+    edge.y_max = high.y;
+    edge.x_min = low.x;
+    edge.dx = high.x - low.x;
+    edge.dy = high.y - low.y;
+    if (edge.dx < 0) {
+        edge.dx = -edge.dx;
+        edge.stepx = -1;
+    } else {
+        edge.stepx = 1;
+    }
+    if (edge.dx > edge.dy)
+        edge.fraction = edge.dy - edge.dx;
+    else
+        edge.fraction = edge.dx - edge.dy;
+    edge.dx = (edge.dx << 1);
+    edge.dy = (edge.dy << 1);
+    return true;
 }
 
-typedef struct edge_t {
-    int y_max;      //< Max ordinate
-    int x_min;     //< Min abscissa
-    int dx;         //< Displacement along x axis
-    int dy;         //< Displacement along y axis
-    int stepx;       //< Step along y axis (+/-1)
-    int fraction;
-    struct edge_t* next;
-} edge_t;
+/**
+ * \brief   Moves x_min of an edge to the next scanline.
+ */
+template <typename Edge>
+static inline void step_edge(Edge& edge)
+{
+    if (edge.dx > edge.dy) {
+        while (edge.fraction < 0) {
+            edge.x_min += edge.stepx;
+            edge.fraction += edge.dy;
+        }
+        edge.fraction -= edge.dx;
+    } else {
+        if (edge.fraction >= 0) {
+            edge.x_min += edge.stepx;
+            edge.fraction -= edge.dy;
+        }
+        edge.fraction += edge.dx;
+    }
+}
+
+Path::Path()
+    : m_min_scanline(0), m_max_scanline(0), m_min_x(0), m_max_x(0)
+{
+}
+
+Path::Path(const linked_point_t* first_point)
+    : m_min_scanline(0), m_max_scanline(0), m_min_x(0), m_max_x(0)
+{
+    set_points(first_point);
+}
+
+void Path::set_points(const linked_point_t* first_point)
+{
+    m_points.clear();
+    for (const linked_point_t* lpoint = first_point; lpoint != NULL; lpoint = lpoint->next) {
+        m_points.push_back(lpoint->point.x);
+        m_points.push_back(lpoint->point.y);
+    }
+    build();
+}
+
+void Path::set_points(const std::vector<float>& coordinates)
+{
+    m_points = coordinates;
+    build();
+}
+
+void Path::build()
+{
+    m_edges.clear();
+    m_segments.clear();
+    m_min_scanline = m_max_scanline = m_min_x = m_max_x = 0;
+    m_coverage_box = Rect();
+    int count = m_points.size() / 2;
+    if (count == 0)
+        return;
+
+    // Compute min/max scanline and abscissa
+    float min_x = m_points[0], max_x = m_points[0], min_y = m_points[1], max_y = m_points[1];
+    m_min_x = m_max_x = lroundf(m_points[0]);
+    m_min_scanline = m_max_scanline = lroundf(m_points[1]);
+    for (int i = 1; i < count; i++) {
+        float x = m_points[2 * i], y = m_points[2 * i + 1];
+        min_x = std::min(min_x, x);
+        max_x = std::max(max_x, x);
+        min_y = std::min(min_y, y);
+        max_y = std::max(max_y, y);
+        m_min_scanline = std::min(m_min_scanline, (int)lroundf(y));
+        m_max_scanline = std::max(m_max_scanline, (int)lroundf(y));
+        m_min_x = std::min(m_min_x, (int)lroundf(x));
+        m_max_x = std::max(m_max_x, (int)lroundf(x));
+    }
+    int left = (int)floorf(min_x), top = (int)floorf(min_y);
+    m_coverage_box = Rect(Point(left, top), Size((int)ceilf(max_x) - left, (int)ceilf(max_y) - top));
+
+    // Store the edges, the last point is linked back to the first one
+    for (int i = 0; i < count; i++) {
+        int j = i + 1 < count ? i + 1 : 0;
+        Point start(lroundf(m_points[2 * i]), lroundf(m_points[2 * i + 1]));
+        Point end(lroundf(m_points[2 * j]), lroundf(m_points[2 * j + 1]));
+
+        // skip horizontal edges
+        edge_t edge;
+        if (init_edge(start, end, edge))
+            m_edges.push_back(edge);
+
+        float x0 = m_points[2 * i], y0 = m_points[2 * i + 1];
+        float x1 = m_points[2 * j], y1 = m_points[2 * j + 1];
+        if (y0 != y1) {
+            segment_t segment;
+            segment.direction = y0 < y1 ? 1.f : -1.f;
+            if (y0 > y1) {
+                std::swap(x0, x1);
+                std::swap(y0, y1);
+            }
+            segment.x_top = x0;
+            segment.y_top = y0;
+            segment.y_bottom = y1;
+            segment.dxdy = (x1 - x0) / (y1 - y0);
+            m_segments.push_back(segment);
+        }
+    }
+
+    // Sorted by increasing y and x of the lower end
+    std::sort(m_edges.begin(), m_edges.end(), [](const edge_t& e1, const edge_t& e2) {
+        return e1.y_min < e2.y_min || (e1.y_min == e2.y_min && e1.x_min < e2.x_min);
+    });
+    std::sort(m_segments.begin(), m_segments.end(), [](const segment_t& s1, const segment_t& s2) {
+        return s1.y_top < s2.y_top;
+    });
+}
+
+bool_t Path::empty() const
+{
+    return m_edges.empty() && m_segments.empty() ? EI_TRUE : EI_FALSE;
+}
+
+Rect Path::bounding_box() const
+{
+    if (m_edges.empty())
+        return Rect();
+    return Rect(Point(m_min_x, m_min_scanline),
+                Size(m_max_x - m_min_x + 1, m_max_scanline - m_min_scanline));
+}
+
+Rect Path::coverage_box() const
+{
+    return m_coverage_box;
+}
 
 /**
- * \brief   Compute min and max scanline (in the y direction) for the given polygon
- *
- * @param   first_point     The head of a linked list of the points of the polygon.
- * @param   min_scanline    Stores the minimum scanline
- * @param   min_scanline    Stores the maximum scanline
+ * \brief   Blends a color on the pixels [x0, x1] of the row y, which are inside the surface.
+ */
+static inline void fill_span(surface_t surface, int y, int x0, int x1, const color_t& color)
+{
+    Point pos(x0, y);
+    for (; pos.x <= x1; pos.x++) {
+        if (color.alpha == 0xff)
+            hw_put_pixel(surface, pos, color);
+        else
+            hw_put_pixel(surface, pos, alpha_blend(color, hw_get_pixel(surface, pos)));
+    }
+}
+
+#ifndef EI_HEADLESS
+/**
+ * \brief   The Allegro pixel format of each \ref surface_format_t, in the byte order of the kernels.
+ */
+static const int k_allegro_formats[] = {
+    ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE,
+    ALLEGRO_PIXEL_FORMAT_XBGR_8888,
+    ALLEGRO_PIXEL_FORMAT_SINGLE_CHANNEL_8
+};
+#endif
+
+surface_t create_surface(const surface_t root, const Size* size, surface_format_t format)
+{
+#ifdef EI_HEADLESS
+    return hw_headless_surface_create(size, format);
+#else
+    if (format == ei_format_rgba8888)
+        return hw_surface_create(root, size);
+
+    int previous = al_get_new_bitmap_format();
+    al_set_new_bitmap_format(k_allegro_formats[format]);
+    ALLEGRO_BITMAP* bitmap = al_create_bitmap(size->width, size->height);
+    al_set_new_bitmap_format(previous);
+    if (bitmap == NULL)
+        return hw_surface_create(root, size);
+    return bitmap;
+#endif
+}
+
+surface_format_t surface_get_format(const surface_t surface)
+{
+#ifdef EI_HEADLESS
+    return hw_headless_get_format(surface);
+#else
+    int format = al_get_bitmap_format((ALLEGRO_BITMAP*) surface);
+    for (int i = 0; i < (int)(sizeof(k_allegro_formats) / sizeof(k_allegro_formats[0])); i++)
+        if (k_allegro_formats[i] == format)
+            return (surface_format_t) i;
+    // Allegro converts the other formats when locking.
+    return ei_format_rgba8888;
+#endif
+}
+
+surface_t create_surface_view(surface_t surface, const Rect* rect)
+{
+    Rect area;
+    if (!rect_intersection(*rect, hw_surface_get_rect(surface), &area))
+        area = Rect(hw_surface_get_rect(surface).top_left, Size(0, 0));
+#ifdef EI_HEADLESS
+    return hw_headless_surface_create_view(surface, &area);
+#else
+    return al_create_sub_bitmap((ALLEGRO_BITMAP*) surface, area.top_left.x, area.top_left.y,
+                                area.size.width, area.size.height);
+#endif
+}
+
+/**
+ * \brief   Returns the surface owning the pixels of a view, and the position of the view in it.
+ *          A surface which is not a view owns its pixels, at the origin.
  */
-void min_max_scanline(const linked_point_t* first_point, int* min_scanline, int* max_scanline)
+static surface_t surface_get_owner(const surface_t surface, Point* origin)
 {
-    *min_scanline = first_point->point.y;
-    *max_scanline = *min_scanline;
-    const linked_point_t* lpoint = first_point->next;
+#ifdef EI_HEADLESS
+    return hw_headless_get_owner(surface, origin);
+#else
+    ALLEGRO_BITMAP* bitmap = (ALLEGRO_BITMAP*) surface;
+    ALLEGRO_BITMAP* parent = al_get_parent_bitmap(bitmap);
+    if (parent == NULL) {
+        *origin = Point(0, 0);
+        return surface;
+    }
+    *origin = Point(al_get_bitmap_x(bitmap), al_get_bitmap_y(bitmap));
+    return parent;
+#endif
+}
 
-    while (lpoint != NULL) {
-        if (lpoint->point.y < *min_scanline)
-            *min_scanline = lpoint->point.y;
-        if (lpoint->point.y > *max_scanline)
-            *max_scanline = lpoint->point.y;
-        lpoint = lpoint->next;
+/**
+ * \brief   Direct access to the pixels of an area of a surface, in the format of the surface.
+ *          If the backend cannot give it (the surface is already locked), the surface is
+ *          locked with \ref hw_surface_lock instead, and \ref locked returns EI_FALSE.
+ */
+class PixelLock {
+public:
+    PixelLock(surface_t surface, const Rect& area)
+        : m_surface(surface), m_pixels(NULL), m_pitch(0), m_format(surface_get_format(surface)),
+          m_bytes(bytes_per_pixel(m_format))
+    {
+#ifdef EI_HEADLESS
+        m_pixels = (uint8_t*) hw_headless_get_data(surface, &m_pitch);
+#else
+        ALLEGRO_BITMAP* bitmap = (ALLEGRO_BITMAP*) surface;
+        ALLEGRO_LOCKED_REGION* region = NULL;
+        if (!al_is_bitmap_locked(bitmap))
+            region = al_lock_bitmap_region(bitmap, area.top_left.x, area.top_left.y,
+                                           area.size.width, area.size.height,
+                                           k_allegro_formats[m_format], ALLEGRO_LOCK_READWRITE);
+        if (region != NULL) {
+            // The locked region starts at the top-left corner of the area.
+            m_pitch = region->pitch;
+            m_pixels = (uint8_t*) region->data - area.top_left.y * m_pitch - area.top_left.x * m_bytes;
+        } else {
+            hw_surface_lock(surface);
+        }
+#endif
+    }
+
+    ~PixelLock()
+    {
+#ifndef EI_HEADLESS
+        if (m_pixels != NULL)
+            al_unlock_bitmap((ALLEGRO_BITMAP*) m_surface);
+        else
+            hw_surface_unlock(m_surface);
+#endif
+    }
+
+    bool_t locked() const
+    {
+        return m_pixels != NULL ? EI_TRUE : EI_FALSE;
+    }
+
+    surface_format_t format() const
+    {
+        return m_format;
+    }
+
+    /**
+     * @return  The address of the pixel (x, y), which must be inside the locked area.
+     */
+    void* at(int x, int y) const
+    {
+        return m_pixels + y * m_pitch + x * m_bytes;
+    }
+
+private:
+    surface_t           m_surface;
+    uint8_t*            m_pixels;   ///< Address of the pixel (0, 0).
+    int                 m_pitch;    ///< Number of bytes between two consecutive rows.
+    surface_format_t    m_format;
+    int                 m_bytes;    ///< Size of a pixel.
+};
+
+/**
+ * \brief   Fills spans with the kernel selected once for the color of a primitive.
+ */
+class SpanWriter {
+public:
+    SpanWriter(surface_t surface, const Rect& area, const color_t& color)
+        : m_surface(surface), m_pixels(surface, area), m_color(color),
+          m_kernel(select_span_kernel(m_pixels.format(), color.alpha == 0xff ? ei_blend_copy : ei_blend_alpha))
+    {
+    }
+
+    /**
+     * \brief   Fills the pixels [x0, x1] of the row y.
+     */
+    void operator()(int y, int x0, int x1) const
+    {
+        if (m_pixels.locked() == EI_TRUE)
+            m_kernel(m_pixels.at(x0, y), x1 - x0 + 1, m_color);
+        else
+            fill_span(m_surface, y, x0, x1, m_color);
+    }
+
+private:
+    surface_t       m_surface;
+    PixelLock       m_pixels;
+    color_t         m_color;
+    span_kernel_t   m_kernel;
+};
+
+template <typename SpanFunction>
+void Path::scan(int clip_x0, int clip_y0, int clip_x1, int clip_y1, SpanFunction span) const
+{
+    std::vector<edge_t>& active_edge_table = m_active_edges;
+    active_edge_table.clear();
+    size_t next_edge = 0;
+    int last_scanline = std::min(m_max_scanline, clip_y1);
+
+    for (int scanline = m_min_scanline; scanline < last_scanline; scanline++) {
+        // Move edges starting on this scanline from ET to AET
+        while (next_edge < m_edges.size() && m_edges[next_edge].y_min == scanline)
+            active_edge_table.push_back(m_edges[next_edge++]);
+
+        // Remove from AET edges for wich y_max = scanline
+        size_t count = 0;
+        for (size_t i = 0; i < active_edge_table.size(); i++)
+            if (active_edge_table[i].y_max != scanline)
+                active_edge_table[count++] = active_edge_table[i];
+        active_edge_table.resize(count);
+
+        // Make sure AET remains sorted by increasing x, it is almost sorted already
+        for (size_t i = 1; i < count; i++) {
+            edge_t edge = active_edge_table[i];
+            size_t j = i;
+            for (; j > 0 && active_edge_table[j - 1].x_min > edge.x_min; j--)
+                active_edge_table[j] = active_edge_table[j - 1];
+            active_edge_table[j] = edge;
+        }
+
+        // Spans between pairs of edges
+        if (scanline >= clip_y0) {
+            for (size_t i = 0; i + 1 < count; i += 2) {
+                int x0 = std::max(active_edge_table[i].x_min, clip_x0);
+                int x1 = std::min(active_edge_table[i + 1].x_min, clip_x1);
+                if (x0 <= x1)
+                    span(scanline, x0, x1);
+            }
+        }
+
+        // Update next x_ymin using Bresenham
+        for (size_t i = 0; i < count; i++)
+            step_edge(active_edge_table[i]);
     }
 }
 
 /**
- * \brief   Allocate and store all edges of the polygon into an edge_table (edge_t)
- *          in the increasing order of y and x.
- *          For example, edge_table[current_scanline] contains all edges for which
- *          lowest y position is current_scanline + min_scanline
+ * \brief   Accumulates the signed area of a segment inside a scanline, from abscissa xa to xb
+ *          relatively to the first cell, and "height" the signed height of the segment. Every
+ *          cell receives the area between the segment and its right side: the running sum of
+ *          the cells along the scanline is then the coverage of the pixels.
  *
- * @param   first_point     The head of a linked list of the points of the polygon.
- * @param   min_scanline    The minimum scanline
- * @param   max_scanline    The maximum scanline
+ * @param   first, last Extended to the cells which are modified.
  */
-edge_t** build_edge_table(const linked_point_t* first_point, int min_scanline, int max_scanline)
-{
-    // Allocate and initialize edge table
-    edge_t** edge_table = (edge_t**)malloc((max_scanline - min_scanline + 1) * sizeof(edge_t*));
-    for (int i = 0; i <= (max_scanline - min_scanline); i++)
-        edge_table[i] = NULL;
-
-    // Fill edge table
-    Point start = first_point->point;
-    const linked_point_t* lpoint = first_point->next;
-    bool_t all_processed = EI_FALSE;
-    edge_t* current_edge, *tmp_edge;
-    int current_scanline;
-
-    while (!all_processed) {
-        if (lpoint == NULL) {
-            lpoint = first_point;
-            all_processed = EI_TRUE;
+static void accumulate_segment(float* cells, float xa, float xb, float height, int& first, int& last)
+{
+    float x0 = std::min(xa, xb), x1 = std::max(xa, xb);
+    int x0i = (int)x0, x1i = (int)ceilf(x1);
+
+    if (x1i <= x0i + 1) {
+        // Inside one pixel: the area right of the middle of the segment goes to the next cell.
+        float xm = 0.5f * (xa + xb) - x0i;
+        cells[x0i] += height * (1.f - xm);
+        cells[x0i + 1] += height * xm;
+    } else {
+        // The segment crosses several pixels: triangles at both ends, trapezoids in between.
+        float slope = 1.f / (x1 - x0);
+        float x0f = x0 - x0i;
+        float a0 = 0.5f * slope * (1.f - x0f) * (1.f - x0f);
+        float x1f = x1 - x1i + 1.f;
+        float am = 0.5f * slope * x1f * x1f;
+        cells[x0i] += height * a0;
+        if (x1i == x0i + 2) {
+            cells[x0i + 1] += height * (1.f - a0 - am);
+        } else {
+            float a1 = slope * (1.5f - x0f);
+            cells[x0i + 1] += height * (a1 - a0);
+            for (int x = x0i + 2; x < x1i - 1; x++)
+                cells[x] += height * slope;
+            float a2 = a1 + (x1i - x0i - 3) * slope;
+            cells[x1i - 1] += height * (1.f - a2 - am);
         }
+        cells[x1i] += height * am;
+    }
+    first = std::min(first, x0i);
+    last = std::max(last, x1i);
+}
 
-        Point end = lpoint->point;
-        // skip horizontal edges
-        if (start.y != end.y) {
-            current_edge = (edge_t*)malloc(sizeof(struct edge_t));
-            if (start.y < end.y) {
-                current_scanline = start.y;
-                current_edge->y_max = end.y;
-                current_edge->x_min = start.x;
-                current_edge->dx = end.x - start.x;
-                current_edge->dy = end.y - start.y;
-            } else {
-                current_scanline = end.y;
-                current_edge->y_max = start.y;
-                current_edge->x_min = end.x;
-                current_edge->dx = start.x - end.x;
-                current_edge->dy = start.y - end.y;
-            }
-            if (current_edge->dx < 0) {
-                current_edge->dx = -current_edge->dx;
-                current_edge->stepx = -1;
-            } else {
-                current_edge->stepx = 1;
+template <typename RunFunction>
+void Path::scan_coverage(int clip_x0, int clip_y0, int clip_x1, int clip_y1, RunFunction run) const
+{
+    const Rect& box = m_coverage_box;
+    int x0 = std::max(clip_x0, box.top_left.x);
+    int x1 = std::min(clip_x1, box.top_left.x + (int)box.size.width - 1);
+    int y0 = std::max(clip_y0, box.top_left.y);
+    int y1 = std::min(clip_y1, box.top_left.y + (int)box.size.height);
+    if (x0 > x1 || y0 >= y1)
+        return;
+
+    // Cells of the pixels x0 to x1, plus two to receive the areas right of x1.
+    int width = x1 - x0 + 1;
+    float right = (float)width;
+    m_cells.assign(width + 2, 0.f);
+    m_coverage.resize(width);
+    float* cells = &m_cells[0];
+    unsigned char* coverage = &m_coverage[0];
+
+    std::vector<size_t>& active = m_active_segments;
+    active.clear();
+    size_t next_segment = 0;
+
+    for (int y = y0; y < y1; y++) {
+        // Segments starting above the bottom of the scanline enter, the ones above it leave.
+        while (next_segment < m_segments.size() && m_segments[next_segment].y_top < y + 1)
+            active.push_back(next_segment++);
+        size_t count = 0;
+        for (size_t i = 0; i < active.size(); i++)
+            if (m_segments[active[i]].y_bottom > y)
+                active[count++] = active[i];
+        active.resize(count);
+
+        std::vector<std::pair<int, int> >& touched = m_touched;
+        touched.clear();
+        for (size_t i = 0; i < count; i++) {
+            const segment_t& segment = m_segments[active[i]];
+            float ya = std::max((float)y, segment.y_top);
+            float yb = std::min((float)(y + 1), segment.y_bottom);
+            if (yb <= ya)
+                continue;
+            float xa = segment.x_top + (ya - segment.y_top) * segment.dxdy - x0;
+            float xb = segment.x_top + (yb - segment.y_top) * segment.dxdy - x0;
+            float height = (yb - ya) * segment.direction;
+
+            // Left of the clipper, the area covers the whole scanline: it goes to the first cell.
+            if (xa < 0.f || xb < 0.f) {
+                touched.push_back(std::make_pair(0, 0));
+                if (xa <= 0.f && xb <= 0.f) {
+                    cells[0] += height;
+                    continue;
+                }
+                float t = -std::min(xa, xb) / fabsf(xb - xa);
+                cells[0] += height * t;
+                height -= height * t;
+                if (xa < 0.f)
+                    xa = 0.f;
+                else
+                    xb = 0.f;
             }
-            if (current_edge->dx > current_edge->dy) {
-                current_edge->fraction = current_edge->dy - current_edge->dx;
-            } else {
-                current_edge->fraction = current_edge->dx - current_edge->dy;
+            // Right of the clipper, it covers nothing.
+            if (xa > right || xb > right) {
+                if (xa >= right && xb >= right)
+                    continue;
+                float t = (std::max(xa, xb) - right) / fabsf(xb - xa);
+                height -= height * t;
+                if (xa > right)
+                    xa = right;
+                else
+                    xb = right;
             }
-            current_edge->dx = (current_edge->dx << 1);
-            current_edge->dy = (current_edge->dy << 1);
-            current_scanline -= min_scanline;
-
-            // Insert in ET sorted by increasing y and x of the lower end
-            if (edge_table[current_scanline] == NULL) {
-                edge_table[current_scanline] = current_edge;
-                current_edge->next = NULL;
-            } else {
-                tmp_edge = edge_table[current_scanline];
-                while (tmp_edge->next != NULL && (tmp_edge->next->y_max <= current_edge->y_max)) {
-                    if ((tmp_edge->next->y_max == current_edge->y_max) && (tmp_edge->next->x_min > current_edge->x_min))
-                        break;
-                    tmp_edge = tmp_edge->next;
+            int first = width, last = -1;
+            accumulate_segment(cells, xa, xb, height, first, last);
+            touched.push_back(std::make_pair(first, last));
+        }
+        if (touched.empty())
+            continue;
+        std::sort(touched.begin(), touched.end());
+
+        // Runs of partially covered pixels, and of entirely covered ones, among [from, to).
+        auto emit = [&](int from, int to) {
+            int x = from;
+            while (x < to) {
+                int start = x;
+                if (coverage[x] == 0xff) {
+                    while (x < to && coverage[x] == 0xff)
+                        x++;
+                    run(y, x0 + start, x - start, (const unsigned char*) NULL);
+                } else if (coverage[x] == 0) {
+                    while (x < to && coverage[x] == 0)
+                        x++;
+                } else {
+                    while (x < to && coverage[x] != 0 && coverage[x] != 0xff)
+                        x++;
+                    run(y, x0 + start, x - start, (const unsigned char*) coverage + start);
                 }
-                current_edge->next = tmp_edge->next;
-                tmp_edge->next = current_edge;
             }
+        };
+        float sum = 0.f;
+        auto emit_constant = [&](int from, int to) {
+            int value = (int)(std::min(fabsf(sum), 1.f) * 255.f + 0.5f);
+            if (to <= from || value == 0)
+                return;
+            if (value == 0xff) {
+                run(y, x0 + from, to - from, (const unsigned char*) NULL);
+                return;
+            }
+            memset(coverage + from, value, to - from);
+            run(y, x0 + from, to - from, (const unsigned char*) coverage + from);
+        };
+
+        // The running sum is only computed over the cells modified by the segments, the coverage
+        // is constant in between. The cells are cleared for the next scanline.
+        int x = 0;
+        size_t i = 0;
+        while (i < touched.size()) {
+            int begin = touched[i].first, end = touched[i].second;
+            for (i++; i < touched.size() && touched[i].first <= end + 1; i++)
+                end = std::max(end, touched[i].second);
+
+            emit_constant(x, std::min(begin, width));
+            int last = std::min(end, width - 1);
+            for (int c = begin; c <= last; c++) {
+                sum += cells[c];
+                coverage[c] = (unsigned char)(std::min(fabsf(sum), 1.f) * 255.f + 0.5f);
+            }
+            std::fill(cells + begin, cells + end + 1, 0.f);
+            emit(begin, last + 1);
+            x = std::max(std::min(begin, width), last + 1);
         }
-        // Process next edge
-        start = end;
-        lpoint = lpoint->next;
+        emit_constant(x, width);
     }
-
-    return edge_table;
 }
 
+/**
+ * \brief   Blends the runs of \ref Path::scan_coverage with the kernels selected once for the
+ *          color of a primitive.
+ */
+class CoverageWriter {
+public:
+    CoverageWriter(surface_t surface, const Rect& area, const color_t& color)
+        : m_surface(surface), m_pixels(surface, area), m_color(color),
+          m_span(select_span_kernel(m_pixels.format(), color.alpha == 0xff ? ei_blend_copy : ei_blend_alpha)),
+          m_mask(select_mask_kernel(m_pixels.format()))
+    {
+    }
+
+    /**
+     * \brief   Blends the "count" pixels from (x, y), weighted by their coverage if not NULL.
+     */
+    void operator()(int y, int x, int count, const unsigned char* coverage) const
+    {
+        if (m_pixels.locked() == EI_TRUE) {
+            if (coverage == NULL)
+                m_span(m_pixels.at(x, y), count, m_color);
+            else
+                m_mask(m_pixels.at(x, y), coverage, count, m_color);
+        } else if (coverage == NULL) {
+            fill_span(m_surface, y, x, x + count - 1, m_color);
+        } else {
+            for (int i = 0; i < count; i++) {
+                color_t color = m_color;
+                color.alpha = div255(color.alpha * coverage[i]);
+                fill_span(m_surface, y, x + i, x + i, color);
+            }
+        }
+    }
+
+private:
+    surface_t       m_surface;
+    PixelLock       m_pixels;
+    color_t         m_color;
+    span_kernel_t   m_span;
+    mask_kernel_t   m_mask;
+};
+
+void Path::draw(surface_t surface, const Point& offset, const color_t& color, const Rect* clipper,
+                bool_t antialiased) const
+{
+    if (empty())
+        return;
+
+    // Clipping bounds, in the coordinates of the path
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    int clip_x0 = clip.top_left.x - offset.x, clip_x1 = clip_x0 + (int)clip.size.width - 1;
+    int clip_y0 = clip.top_left.y - offset.y, clip_y1 = clip_y0 + (int)clip.size.height;
+
+    Rect bounds = antialiased == EI_TRUE ? coverage_box() : bounding_box();
+    if (!rect_intersection(Rect(bounds.top_left + offset, bounds.size), clip, &clip))
+        return;
+    BlitBatch::getInstance().touch(surface, clip);
+
+    if (antialiased == EI_TRUE) {
+        CoverageWriter writer(surface, clip, color);
+        scan_coverage(clip_x0, clip_y0, clip_x1, clip_y1,
+                      [&](int y, int x, int count, const unsigned char* coverage) {
+            writer(y + offset.y, x + offset.x, count, coverage);
+        });
+        return;
+    }
+
+    SpanWriter writer(surface, clip, color);
+    scan(clip_x0, clip_y0, clip_x1, clip_y1, [&](int y, int x0, int x1) {
+        writer(y + offset.y, x0 + offset.x, x1 + offset.x);
+    });
+}
 
 /**
- * @brief Debugging functions to print the edge tables
+ * \brief   Appends the points of an arc to a list of coordinates, see \ref arc.
  */
-void print_edge_table_entry(edge_t* edge)
+static void arc_points(std::vector<float>& points, float center_x, float center_y, float radius,
+                       int start_angle, int end_angle)
 {
-    while (edge != NULL) {
-        printf("[%d, %d, %d, %d, %d, %d] ", edge->y_max,
-               edge->x_min, edge->dx, edge->dy,
-               edge->stepx, edge->fraction);
-        edge = edge->next;
+    float angle = (end_angle - start_angle) * M_PI/180.f;
+    int nbpts = std::max(1, (int)(radius * fabsf(angle)));
+    for (int i = 0; i <= nbpts; i++) {
+        float a = start_angle * M_PI/180.f + (float)i * angle / (float)nbpts;
+        points.push_back(center_x + radius * cosf(a));
+        points.push_back(center_y + radius * sinf(a));
     }
-    printf("\n");
 }
 
-void print_edge_table(edge_t** edge_table, int min_scanline, int max_scanline)
+Path rounded_frame_path(const Rect& rect, float radius, bt_part part)
 {
-    edge_t* current_edge;
-    printf("Edge table:\n");
-    for (int i = 0; i <= (max_scanline - min_scanline); i++) {
-        if (edge_table[i] != NULL) {
-            printf("%d: ", i + min_scanline);
-            current_edge = edge_table[i];
-            print_edge_table_entry(current_edge);
+    // The outline of rounded_frame at sub-pixel precision, along the sides of the pixels.
+    float x0 = rect.top_left.x, y0 = rect.top_left.y;
+    float width = rect.size.width, height = rect.size.height;
+    float x1 = x0 + width, y1 = y0 + height;
+    radius = std::max(0.f, std::min(radius, 0.5f * std::min(width, height)));
+
+    std::vector<float> points;
+    if (part != BT_BOTTOM) {
+        arc_points(points, x0 + radius, y1 - radius, radius, 135, 180);
+        arc_points(points, x0 + radius, y0 + radius, radius, 180, 270);
+        arc_points(points, x1 - radius, y0 + radius, radius, 270, 315);
+    }
+    if (part == BT_TOP) {
+        points.push_back(x0 + 2.f * width / 3.f);
+        points.push_back(y0 + height / 2.f);
+        points.push_back(x0 + width / 3.f);
+        points.push_back(y0 + height / 2.f);
+    } else {
+        arc_points(points, x1 - radius, y0 + radius, radius, 315, 360);
+        arc_points(points, x1 - radius, y1 - radius, radius, 0, 90);
+        arc_points(points, x0 + radius, y1 - radius, radius, 90, 135);
+        if (part == BT_BOTTOM) {
+            points.push_back(x0 + width / 3.f);
+            points.push_back(y0 + height / 2.f);
+            points.push_back(x0 + 2.f * width / 3.f);
+            points.push_back(y0 + height / 2.f);
         }
     }
-    printf("\n");
+
+    Path path;
+    path.set_points(points);
+    return path;
 }
 
 void draw_polygon(surface_t surface, const linked_point_t* first_point,
-                  const color_t& color, const Rect* clipper)
+                  const color_t& color, const Rect* clipper, bool_t antialiased)
 {
-    edge_t* active_edge_table = NULL;
-    edge_t* current_edge, * tmp_edge, * prev_edge;
-    Point pos;
-    int current_scanline;
-    color_t p;
-
     if (first_point == NULL) {
         fprintf(stderr, "no point for the polygon\n");
         return;
     }
 
-    hw_surface_lock(surface);
+    // Reused from call to call so that its storage is only allocated once.
+    static Path s_path;
+    s_path.set_points(first_point);
+    s_path.draw(surface, Point(), color, clipper, antialiased);
+}
+
+/**
+ * \brief   An edge of \ref draw_polygons, tagged with the index of its polygon.
+ */
+struct batch_edge_t {
+    int polygon;
+    int y_min;
+    int y_max;
+    int x_min;
+    int dx;
+    int dy;
+    int stepx;
+    int fraction;
+};
+
+static inline bool batch_edge_before(const batch_edge_t& a, const batch_edge_t& b)
+{
+    return a.polygon < b.polygon || (a.polygon == b.polygon && a.x_min < b.x_min);
+}
+
+void draw_polygons(surface_t surface, const polygon_t* polygons, int count, const Rect* clipper)
+{
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+
+    // Edge tables of all the polygons, reused from call to call so that their storage is
+    // only allocated once.
+    static std::vector<batch_edge_t> s_edges;
+    static std::vector<batch_edge_t> s_active_edges;
+    s_edges.clear();
+    int min_x = INT_MAX, max_x = INT_MIN, min_scanline = INT_MAX, max_scanline = INT_MIN;
+    for (int p = 0; p < count; p++) {
+        const linked_point_t* first_point = polygons[p].first_point;
+        if (first_point == NULL || polygons[p].color.alpha == 0)
+            continue;
+        for (const linked_point_t* lpoint = first_point; lpoint != NULL; lpoint = lpoint->next) {
+            const Point& start = lpoint->point;
+            const Point& end = lpoint->next != NULL ? lpoint->next->point : first_point->point;
+            min_x = std::min(min_x, start.x);
+            max_x = std::max(max_x, start.x);
+            min_scanline = std::min(min_scanline, start.y);
+            max_scanline = std::max(max_scanline, start.y);
+
+            batch_edge_t edge;
+            edge.polygon = p;
+            if (init_edge(start, end, edge))
+                s_edges.push_back(edge);
+        }
+    }
+    if (s_edges.empty())
+        return;
+    // By polygon on each scanline, so that the active edge table stays almost sorted.
+    std::sort(s_edges.begin(), s_edges.end(), [](const batch_edge_t& a, const batch_edge_t& b) {
+        return a.y_min < b.y_min || (a.y_min == b.y_min && batch_edge_before(a, b));
+    });
+
+    int clip_x0 = clip.top_left.x, clip_x1 = clip_x0 + (int)clip.size.width - 1;
+    int clip_y0 = clip.top_left.y, clip_y1 = clip_y0 + (int)clip.size.height;
+    Rect bounds(Point(min_x, min_scanline), Size(max_x - min_x + 1, max_scanline - min_scanline + 1));
+    if (!rect_intersection(bounds, clip, &clip))
+        return;
+    BlitBatch::getInstance().touch(surface, clip);
 
-    // Compute min/max scanline
-    int min_scanline, max_scanline;
-    min_max_scanline(first_point, &min_scanline, &max_scanline);
+    PixelLock pixels(surface, clip);
+    span_kernel_t copy = select_span_kernel(pixels.format(), ei_blend_copy);
+    span_kernel_t blend = select_span_kernel(pixels.format(), ei_blend_alpha);
 
+    std::vector<batch_edge_t>& active_edge_table = s_active_edges;
+    active_edge_table.clear();
+    size_t next_edge = 0;
+    int last_scanline = std::min(max_scanline, clip_y1);
 
-    edge_t** edge_table = build_edge_table(first_point, min_scanline, max_scanline);
+    for (int scanline = min_scanline; scanline < last_scanline; scanline++) {
+        while (next_edge < s_edges.size() && s_edges[next_edge].y_min == scanline)
+            active_edge_table.push_back(s_edges[next_edge++]);
 
-#ifdef DEBUG
-    print_edge_table(edge_table, min_scanline, max_scanline);
-#endif
+        size_t active = 0;
+        for (size_t i = 0; i < active_edge_table.size(); i++)
+            if (active_edge_table[i].y_max != scanline)
+                active_edge_table[active++] = active_edge_table[i];
+        active_edge_table.resize(active);
 
-    for (current_scanline = 0; current_scanline <= (max_scanline - min_scanline); current_scanline++) {
-        // Move edges from ET[current_scanline] to AET sorted by increasing x of the lower end
-        current_edge = edge_table[current_scanline];
-        prev_edge = active_edge_table;
-        while (current_edge != NULL) {
-            if (active_edge_table == NULL) {
-                active_edge_table = current_edge;
-                break;
-            } else {
-                if (active_edge_table->x_min > current_edge->x_min) {
-                    tmp_edge = current_edge->next;
-                    current_edge->next = active_edge_table;
-                    active_edge_table = current_edge;
-                    current_edge = tmp_edge;
-                } else {
-                    while (prev_edge->next != NULL &&
-                           prev_edge->next->x_min < current_edge->x_min) {
-                        prev_edge = prev_edge->next;
-                    }
-                    tmp_edge = current_edge->next;
-                    current_edge->next = prev_edge->next;
-                    prev_edge->next = current_edge;
-                    current_edge = tmp_edge;
-                }
-            }
+        // Sorted by polygon, then by increasing x: the spans of a row are then filled in the
+        // order of the polygons, which keeps the overlaps as separate draws would leave them.
+        for (size_t i = 1; i < active; i++) {
+            batch_edge_t edge = active_edge_table[i];
+            size_t j = i;
+            for (; j > 0 && batch_edge_before(edge, active_edge_table[j - 1]); j--)
+                active_edge_table[j] = active_edge_table[j - 1];
+            active_edge_table[j] = edge;
         }
 
-        // Remove from AET edges for wich y_max = current_scanline + min_scanline
-        current_edge = active_edge_table;
-        tmp_edge = NULL;
-        while (current_edge != NULL) {
-            if (current_edge->y_max == current_scanline + min_scanline) {
-                if (tmp_edge == NULL)
-                    active_edge_table = current_edge->next;
+        if (scanline >= clip_y0) {
+            for (size_t i = 0; i + 1 < active; i += 2) {
+                const batch_edge_t& left = active_edge_table[i];
+                const batch_edge_t& right = active_edge_table[i + 1];
+                // A closed polygon always has an even number of active edges
+                if (left.polygon != right.polygon)
+                    continue;
+                int x0 = std::max(left.x_min, clip_x0);
+                int x1 = std::min(right.x_min, clip_x1);
+                if (x0 > x1)
+                    continue;
+                const color_t& color = polygons[left.polygon].color;
+                if (pixels.locked() == EI_TRUE)
+                    (color.alpha == 0xff ? copy : blend)(pixels.at(x0, scanline), x1 - x0 + 1, color);
                 else
-                    tmp_edge->next = current_edge->next;
-            } else {
-                tmp_edge = current_edge;
+                    fill_span(surface, scanline, x0, x1, color);
             }
-            current_edge = current_edge->next;
         }
 
-#ifdef DEBUG
-        printf("%d: ", current_scanline + min_scanline);
-        print_edge_table_entry(active_edge_table)
-#endif
+        for (size_t i = 0; i < active; i++)
+            step_edge(active_edge_table[i]);
+    }
+}
 
-        // Fill pixel values
-        current_edge = active_edge_table;
-        while (current_edge != NULL) {
-            pos.y = current_scanline + min_scanline;
-            for (pos.x = ceil(current_edge->x_min); pos.x <= floor(current_edge->next->x_min); pos.x++) {
-                if (clipper == NULL ||
-                        ((clipper->top_left.x <= pos.x) && (pos.x < clipper->top_left.x + clipper->size.width)
-                         && (clipper->top_left.y <= pos.y) && (pos.y < clipper->top_left.y + clipper->size.height))) {
-                    p = hw_get_pixel(surface, pos);
-                    hw_put_pixel(surface, pos, alpha_blend(color, p));
-                }
+
+/**
+ * \brief   Number of pixels left out of the row "j" on each side of a rectangle of height "h"
+ *          with rounded corners of radius "r".
+ */
+static int rounded_inset(int r, int h, int j)
+{
+    if (j >= r && j < h - r)
+        return 0;
+    // Distance from the row to the centers of the corners, measured at the pixel centers
+    float dy = (j < r ? r - j : j - (h - r) + 1) - 0.5f;
+    return r - (int)floorf(sqrtf(r * r - dy * dy) + 0.5f);
+}
+
+/**
+ * \brief   Calls "span" on the rows of a rectangle with rounded corners, within "clip".
+ */
+template <typename SpanFunction>
+static void rounded_rect_spans(const Rect& rect, int radius, const Rect& clip, const SpanFunction& span)
+{
+    int x = rect.top_left.x, y = rect.top_left.y;
+    int w = rect.size.width, h = rect.size.height;
+    int r = std::max(0, std::min(radius, std::min(w, h) / 2));
+    int clip_x0 = clip.top_left.x, clip_x1 = clip_x0 + (int)clip.size.width - 1;
+    int clip_y0 = clip.top_left.y, clip_y1 = clip_y0 + (int)clip.size.height;
+
+    for (int row = clip_y0; row < clip_y1; row++) {
+        int inset = rounded_inset(r, h, row - y);
+        int x0 = std::max(x + inset, clip_x0);
+        int x1 = std::min(x + w - 1 - inset, clip_x1);
+        if (x0 <= x1)
+            span(row, x0, x1);
+    }
+}
+
+void fill_rounded_rect(surface_t surface, const Rect& rect, int radius,
+                       const color_t& color, const Rect* clipper)
+{
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    if (!rect_intersection(rect, clip, &clip))
+        return;
+    BlitBatch::getInstance().touch(surface, clip);
+
+    SpanWriter writer(surface, clip, color);
+    rounded_rect_spans(rect, radius, clip, writer);
+}
+
+/**
+ * \brief   Writes an id on the spans of an \ref IdBuffer.
+ */
+class IdWriter {
+public:
+    IdWriter(IdBuffer& buffer, uint32_t id)
+        : m_buffer(buffer), m_id(id)
+    {
+    }
+
+    void operator()(int y, int x0, int x1) const
+    {
+        m_buffer.fill_span(y, x0, x1, m_id);
+    }
+
+private:
+    IdBuffer&   m_buffer;
+    uint32_t    m_id;
+};
+
+void fill_rounded_rect(IdBuffer& buffer, const Rect& rect, int radius,
+                       uint32_t id, const Rect* clipper)
+{
+    Rect clip(Point(0, 0), buffer.size());
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    if (!rect_intersection(rect, clip, &clip))
+        return;
+
+    rounded_rect_spans(rect, radius, clip, IdWriter(buffer, id));
+}
+
+/**
+ * \brief   Fills the spans of two writers in the same loop.
+ */
+template <typename First, typename Second>
+class SpanPair {
+public:
+    SpanPair(const First& first, const Second& second)
+        : m_first(first), m_second(second)
+    {
+    }
+
+    void operator()(int y, int x0, int x1) const
+    {
+        m_first(y, x0, x1);
+        m_second(y, x0, x1);
+    }
+
+private:
+    const First&    m_first;
+    const Second&   m_second;
+};
+
+void fill_rounded_rect(surface_t surface, IdBuffer* buffer, const Rect& rect, int radius,
+                       const color_t& color, uint32_t id, const Rect* clipper)
+{
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    if (!rect_intersection(rect, clip, &clip))
+        return;
+
+    // The buffer must cover every colored pixel for the two to share the spans.
+    Rect covered;
+    if (buffer == NULL || !rect_intersection(clip, Rect(Point(0, 0), buffer->size()), &covered)
+            || covered.size.width != clip.size.width || covered.size.height != clip.size.height) {
+        fill_rounded_rect(surface, rect, radius, color, &clip);
+        if (buffer != NULL)
+            fill_rounded_rect(*buffer, rect, radius, id, &clip);
+        return;
+    }
+    BlitBatch::getInstance().touch(surface, clip);
+
+    SpanWriter colors(surface, clip, color);
+    IdWriter ids(*buffer, id);
+    rounded_rect_spans(rect, radius, clip, SpanPair<SpanWriter, IdWriter>(colors, ids));
+}
+
+bool_t rounded_rect_contains(const Rect& rect, int radius, const Point& where)
+{
+    if (!rect_contains(rect, where))
+        return EI_FALSE;
+    int w = rect.size.width, h = rect.size.height;
+    int r = std::max(0, std::min(radius, std::min(w, h) / 2));
+    int inset = rounded_inset(r, h, where.y - rect.top_left.y);
+    int i = where.x - rect.top_left.x;
+    return i >= inset && i < w - inset ? EI_TRUE : EI_FALSE;
+}
+
+const uint32_t IdBuffer::k_no_id;
+
+IdBuffer::IdBuffer()
+    : m_shift(0), m_width(0), m_height(0)
+{
+}
+
+void IdBuffer::resize(const Size& size, bool_t half_resolution)
+{
+    m_size = size;
+    m_shift = half_resolution == EI_TRUE ? 1 : 0;
+    m_width = ((int)size.width + m_shift) >> m_shift;
+    m_height = ((int)size.height + m_shift) >> m_shift;
+    m_ids.assign(m_width * m_height, k_no_id);
+}
+
+void IdBuffer::fill_span(int y, int x0, int x1, uint32_t id)
+{
+    // At half resolution, every id is the one of the top-left pixel of its 2x2 block.
+    if ((y & ((1 << m_shift) - 1)) != 0)
+        return;
+    x0 = (x0 + (1 << m_shift) - 1) >> m_shift;
+    x1 = x1 >> m_shift;
+    if (x0 <= x1)
+        std::fill(m_ids.begin() + (y >> m_shift) * m_width + x0,
+                  m_ids.begin() + (y >> m_shift) * m_width + x1 + 1, id);
+}
+
+void fill_circle(surface_t surface, const Point& center, int radius,
+                 const color_t& color, const Rect* clipper)
+{
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    if (radius < 0)
+        return;
+    Rect disc(center - Point(radius, radius), Size(2 * radius + 1, 2 * radius + 1));
+    if (!rect_intersection(disc, clip, &clip))
+        return;
+    BlitBatch::getInstance().touch(surface, clip);
+
+    int clip_x0 = clip.top_left.x, clip_x1 = clip_x0 + (int)clip.size.width - 1;
+    int y0 = std::max(center.y - radius, clip.top_left.y);
+    int y1 = std::min(center.y + radius, clip.top_left.y + (int)clip.size.height - 1);
+
+    SpanWriter writer(surface, clip, color);
+    for (int row = y0; row <= y1; row++) {
+        int dy = row - center.y;
+        int half = (int)floorf(sqrtf((float)(radius * radius - dy * dy)) + 0.5f);
+        int x0 = std::max(center.x - half, clip_x0);
+        int x1 = std::min(center.x + half, clip_x1);
+        if (x0 <= x1)
+            writer(row, x0, x1);
+    }
+}
+
+Mask::Mask(const Path& path, const Path* hole)
+    : m_rect(path.coverage_box()), m_surface(NULL)
+{
+    int width = m_rect.size.width, height = m_rect.size.height;
+    int x0 = m_rect.top_left.x, y0 = m_rect.top_left.y;
+    m_coverage.assign(width * height, 0);
+
+    path.scan_coverage(x0, y0, x0 + width - 1, y0 + height,
+                       [&](int y, int x, int count, const unsigned char* coverage) {
+        unsigned char* row = &m_coverage[(y - y0) * width + x - x0];
+        if (coverage == NULL)
+            memset(row, 0xff, count);
+        else
+            memcpy(row, coverage, count);
+    });
+    if (hole != NULL) {
+        hole->scan_coverage(x0, y0, x0 + width - 1, y0 + height,
+                            [&](int y, int x, int count, const unsigned char* coverage) {
+            unsigned char* row = &m_coverage[(y - y0) * width + x - x0];
+            for (int i = 0; i < count; i++)
+                row[i] = coverage == NULL ? 0 : div255(row[i] * (255 - coverage[i]));
+        });
+    }
+
+    m_opaque_runs.resize(height);
+    for (int y = 0; y < height; y++) {
+        const unsigned char* row = &m_coverage[y * width];
+        run_t longest = {0, 0};
+        int x = 0;
+        while (x < width) {
+            if (row[x] != 0xff) {
+                x++;
+                continue;
+            }
+            int begin = x;
+            while (x < width && row[x] == 0xff)
+                x++;
+            if (x - begin > longest.end - longest.begin) {
+                longest.begin = begin;
+                longest.end = x;
             }
-            current_edge = current_edge->next->next;
         }
+        m_opaque_runs[y] = longest;
+    }
+}
 
-        current_edge = active_edge_table;
-        tmp_edge = NULL;
-        prev_edge = NULL;
-        int i = 0;
-        while (current_edge != NULL) {
-            // Update next x_ymin using Bersenham
-            if (current_edge->dx > current_edge->dy) {
-                while (current_edge->fraction < 0) {
-                    current_edge->x_min += current_edge->stepx;
-                    current_edge->fraction += current_edge->dy;
-                }
-                current_edge->fraction -= current_edge->dx;
-            } else {
-                if (current_edge->fraction >= 0) {
-                    current_edge->x_min += current_edge->stepx;
-                    current_edge->fraction -= current_edge->dy;
-                }
-                current_edge->fraction += current_edge->dx;
-            }
+Mask::~Mask()
+{
+    if (m_surface != NULL)
+        hw_surface_free(m_surface);
+}
 
-            // Make sure TCA remains sorted by increasing x of the lower end
-            if ((tmp_edge != NULL) && (tmp_edge->x_min > current_edge->x_min)) {
-                // swap entries
-                if (prev_edge != NULL) {
-                    prev_edge->next = current_edge;
-                    tmp_edge->next = current_edge->next;
-                    current_edge->next = tmp_edge;
-                } else {
-                    active_edge_table = current_edge;
-                    tmp_edge->next = current_edge->next;
-                    current_edge->next = tmp_edge;
-                }
-                current_edge = tmp_edge;
+const Rect& Mask::rect() const
+{
+    return m_rect;
+}
+
+#ifndef EI_HEADLESS
+/**
+ * \brief   Source of the pixel shader that tints an \ref ei_format_a8 bitmap: Allegro samples
+ *          its single channel as red.
+ */
+static const char* k_coverage_shader_source =
+    "#ifdef GL_ES\n"
+    "precision mediump float;\n"
+    "#endif\n"
+    "uniform sampler2D al_tex;\n"
+    "varying vec4 varying_color;\n"
+    "varying vec2 varying_texcoord;\n"
+    "void main()\n"
+    "{\n"
+    "    gl_FragColor = varying_color * texture2D(al_tex, varying_texcoord).r;\n"
+    "}\n";
+
+/**
+ * \brief   The shader that draws the coverage of a mask from a single channel bitmap. It is
+ *          built on the first call, and is NULL when the display has no programmable pipeline.
+ */
+static ALLEGRO_SHADER* coverage_shader()
+{
+    static bool built = false;
+    static ALLEGRO_SHADER* shader = NULL;
+    if (built)
+        return shader;
+    built = true;
+
+    ALLEGRO_DISPLAY* display = al_get_current_display();
+    if (display == NULL || (al_get_display_flags(display) & ALLEGRO_PROGRAMMABLE_PIPELINE) == 0)
+        return NULL;
+    shader = al_create_shader(ALLEGRO_SHADER_GLSL);
+    if (shader == NULL)
+        return NULL;
+    if (!al_attach_shader_source(shader, ALLEGRO_VERTEX_SHADER,
+                                 al_get_default_shader_source(ALLEGRO_SHADER_GLSL, ALLEGRO_VERTEX_SHADER))
+            || !al_attach_shader_source(shader, ALLEGRO_PIXEL_SHADER, k_coverage_shader_source)
+            || !al_build_shader(shader)) {
+        fprintf(stderr, "the coverage shader could not be built, masks are uploaded as RGBA\n");
+        al_destroy_shader(shader);
+        shader = NULL;
+    }
+    return shader;
+}
+#endif
+
+void Mask::draw(surface_t surface, const Point& where, const color_t& color, const Rect* clipper) const
+{
+    Rect clip = hw_surface_get_rect(surface);
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+    Rect target(where + m_rect.top_left, m_rect.size);
+    if (!rect_intersection(target, clip, &clip))
+        return;
+    BlitBatch::getInstance().touch(surface, clip);
+
+#ifndef EI_HEADLESS
+    // The coverage is uploaded once, then tinted by the color on every draw. It is a single
+    // channel bitmap when the shader can read it, or else a white bitmap premultiplied by
+    // the coverage.
+    ALLEGRO_SHADER* shader = coverage_shader();
+    if (m_surface == NULL) {
+        if (shader != NULL)
+            m_surface = create_surface(surface, &m_rect.size, ei_format_a8);
+        if (m_surface == NULL || surface_get_format(m_surface) != ei_format_a8) {
+            hw_surface_free(m_surface);
+            m_surface = hw_surface_create(surface, &m_rect.size);
+        }
+        hw_surface_lock(m_surface);
+        for (int y = 0; y < (int)m_rect.size.height; y++) {
+            for (int x = 0; x < (int)m_rect.size.width; x++) {
+                unsigned char c = m_coverage[y * (int)m_rect.size.width + x];
+                color_t white = {c, c, c, c};
+                hw_put_pixel(m_surface, Point(x, y), white);
             }
-            prev_edge = tmp_edge;
-            tmp_edge = current_edge;
-            current_edge = current_edge->next;
-            i++;
         }
+        hw_surface_unlock(m_surface);
     }
-    hw_surface_unlock(surface);
+#endif
+
+    RenderState& state = RenderState::getInstance();
+    state.set_target(surface);
+    state.set_blender(ei_blend_premultiplied);
+    state.set_clip(&clip);
+
+#ifdef EI_HEADLESS
+    // The fully covered pixels are filled, only the others are weighted by their coverage.
+    PixelLock pixels(surface, clip);
+    mask_kernel_t kernel = select_mask_kernel(pixels.format());
+    span_kernel_t span = select_span_kernel(pixels.format(), color.alpha == 0xff ? ei_blend_copy : ei_blend_alpha);
+    int width = m_rect.size.width;
+    int x0 = clip.top_left.x - target.top_left.x, x1 = x0 + (int)clip.size.width;
+    int y0 = clip.top_left.y - target.top_left.y, y1 = y0 + (int)clip.size.height;
+
+    for (int y = y0; y < y1; y++) {
+        const unsigned char* row = &m_coverage[y * width];
+        int begin = std::min(std::max(m_opaque_runs[y].begin, x0), x1);
+        int end = std::max(std::min(m_opaque_runs[y].end, x1), begin);
+        int target_y = target.top_left.y + y;
+        if (begin > x0)
+            kernel(pixels.at(target.top_left.x + x0, target_y), row + x0, begin - x0, color);
+        if (end > begin)
+            span(pixels.at(target.top_left.x + begin, target_y), end - begin, color);
+        if (x1 > end)
+            kernel(pixels.at(target.top_left.x + end, target_y), row + end, x1 - end, color);
+    }
+#else
+    bool single_channel = surface_get_format(m_surface) == ei_format_a8;
+    if (single_channel)
+        al_use_shader(shader);
+    al_draw_tinted_bitmap((ALLEGRO_BITMAP*) m_surface,
+                          al_map_rgba(color.red * color.alpha / 255, color.green * color.alpha / 255,
+                                      color.blue * color.alpha / 255, color.alpha),
+                          target.top_left.x, target.top_left.y, 0);
+    if (single_channel)
+        al_use_shader(NULL);
+#endif
 }
 
+bool MaskCache::key_t::operator<(const key_t& other) const
+{
+    if (kind != other.kind)
+        return kind < other.kind;
+    if (width != other.width)
+        return width < other.width;
+    if (height != other.height)
+        return height < other.height;
+    if (radius != other.radius)
+        return radius < other.radius;
+    return parameter < other.parameter;
+}
+
+const size_t MaskCache::k_max_masks;
+const int MaskCache::k_radius_steps;
+
+MaskCache::MaskCache()
+{
+}
+
+MaskCache::~MaskCache()
+{
+    clear();
+}
+
+const Mask& MaskCache::rounded_frame(const Size& size, float radius, bt_part part)
+{
+    key_t key = {0, (int)size.width, (int)size.height, (int)lroundf(radius * k_radius_steps), part};
+    std::map<key_t, Mask*>::iterator it = m_masks.find(key);
+    if (it != m_masks.end())
+        return *it->second;
+
+    // The mask is built from the rounded radius, so that it does not depend on the first caller.
+    Path path = rounded_frame_path(Rect(Point(), size), (float)key.radius / k_radius_steps, part);
+    Mask* mask = new Mask(path);
+    m_masks[key] = mask;
+    return *mask;
+}
+
+const Mask& MaskCache::rounded_ring(const Size& size, float radius, int width)
+{
+    key_t key = {1, (int)size.width, (int)size.height, (int)lroundf(radius * k_radius_steps), width};
+    std::map<key_t, Mask*>::iterator it = m_masks.find(key);
+    if (it != m_masks.end())
+        return *it->second;
+
+    radius = (float)key.radius / k_radius_steps;
+    float inner_radius = radius > width ? radius - width : 0.f;
+    Path outer = rounded_frame_path(Rect(Point(), size), radius, BT_FULL);
+    Path inner = rounded_frame_path(Rect(Point(width, width), size - Size(2 * width, 2 * width)),
+                                    inner_radius, BT_FULL);
+    Mask* mask = new Mask(outer, &inner);
+    m_masks[key] = mask;
+    return *mask;
+}
+
+void MaskCache::trim()
+{
+    // Forget everything rather than grow forever.
+    if (m_masks.size() > k_max_masks)
+        clear();
+}
+
+void MaskCache::clear()
+{
+    for (std::map<key_t, Mask*>::iterator it = m_masks.begin(); it != m_masks.end(); ++it)
+        delete it->second;
+    m_masks.clear();
+}
 
 void draw_text(surface_t surface, const Point* where,
                   const char* text, const font_t font,
@@ -427,33 +1483,187 @@ void draw_text(surface_t surface, const Point* where,
     } else {
         s_text = hw_text_create_surface(text, font, color);
     }
+#ifndef EI_HEADLESS
+    // The backend renders the text with its own target and blender.
+    RenderState::getInstance().invalidate();
+#endif
 
-    ei_copy_surface(surface, s_text, where, EI_TRUE);
-
-    hw_surface_free(s_text);
+    // The text surface is freed once it has been drawn.
+    BlitBatch::getInstance().add(surface, s_text, where == NULL ? Point() : *where, EI_TRUE, EI_TRUE);
 }
 
 void fill(surface_t surface, const color_t* color, const bool_t use_alpha)
 {
     const color_t* c = color == NULL ? &ei_font_default_color : color;
 
-    al_set_target_bitmap((ALLEGRO_BITMAP*) surface);
+    BlitBatch::getInstance().touch(surface, hw_surface_get_rect(surface));
+
+    RenderState& state = RenderState::getInstance();
+    state.set_target(surface);
+    state.set_clip(NULL);
+
+#ifdef EI_HEADLESS
+    color_t value = *c;
+    if (use_alpha != EI_TRUE)
+        value.alpha = 0xff;
+
+    Rect rect = hw_surface_get_rect(surface);
+    PixelLock pixels(surface, rect);
+    span_kernel_t kernel = select_span_kernel(pixels.format(), ei_blend_copy);
+    for (int y = 0; y < (int)rect.size.height; y++)
+        kernel(pixels.at(0, y), rect.size.width, value);
+#else
     if(use_alpha == EI_TRUE)
         al_clear_to_color(al_map_rgba(c->red, c->green, c->blue, c->alpha));
     else
         al_clear_to_color(al_map_rgba(c->red, c->green, c->blue, 0xff));
+#endif
 }
 
 
+#ifdef EI_HEADLESS
+/**
+ * \brief   Copies a surface without batching, see \ref ei_copy_surface.
+ */
+static void copy_surface(surface_t destination, const surface_t source,
+                         const Point& origin, const bool_t use_alpha)
+{
+    Rect area;
+    if (!rect_intersection(Rect(origin, hw_surface_get_size(source)), hw_surface_get_rect(destination), &area))
+        return;
+    PixelLock dst(destination, area);
+    PixelLock src(source, hw_surface_get_rect(source));
+
+    // Same equations as the Allegro blenders: source is premultiplied by its alpha.
+    blit_kernel_t kernel = select_blit_kernel(dst.format(), src.format(),
+                                              use_alpha == EI_TRUE ? ei_blend_premultiplied : ei_blend_copy);
+    for (int y = area.top_left.y; y < area.top_left.y + (int)area.size.height; y++)
+        kernel(dst.at(area.top_left.x, y), src.at(area.top_left.x - origin.x, y - origin.y), area.size.width);
+}
+#endif
+
 void ei_copy_surface(surface_t destination, const surface_t source,
                      const Point* where, const bool_t use_alpha)
 {
-    if(use_alpha == EI_TRUE)
-        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
-    else
-        al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_ZERO);
-    al_set_target_bitmap((ALLEGRO_BITMAP*) destination);
-    al_draw_bitmap((ALLEGRO_BITMAP*) source, where->x, where->y, 0);
+    BlitBatch::getInstance().add(destination, source, where == NULL ? Point() : *where, use_alpha, EI_FALSE);
+}
+
+BlitBatch::BlitBatch()
+    : m_open(EI_FALSE)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    memset(&m_last, 0, sizeof(m_last));
+}
+
+void BlitBatch::begin()
+{
+    submit();
+    m_open = EI_TRUE;
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void BlitBatch::end()
+{
+    submit();
+    m_open = EI_FALSE;
+    m_last = m_stats;
+}
+
+void BlitBatch::add(surface_t destination, surface_t source, const Point& where,
+                    bool_t use_alpha, bool_t owned)
+{
+    Point origin, source_origin;
+    surface_t owner = surface_get_owner(destination, &origin);
+    surface_t source_owner = surface_get_owner(source, &source_origin);
+    blit_t blit = {destination, source, where, owner, Rect(origin + where, hw_surface_get_size(source)),
+                   source_owner, Rect(source_origin, hw_surface_get_size(source)), use_alpha, owned};
+
+    // The source must be complete before it is read.
+    if (!m_blits.empty() && source_is_pending(source))
+        submit();
+
+    m_blits.push_back(blit);
+    m_stats.blits++;
+    if (m_open == EI_FALSE || m_blits.size() >= k_max_blits)
+        submit();
+}
+
+void BlitBatch::touch(surface_t surface, const Rect& area)
+{
+    if (m_blits.empty())
+        return;
+    Point origin;
+    surface_t owner = surface_get_owner(surface, &origin);
+    Rect touched(origin + area.top_left, area.size), overlap;
+
+    // Drawing over a queued blit changes its result, and so does drawing into its source.
+    for (size_t i = 0; i < m_blits.size(); i++) {
+        if ((m_blits[i].owner == owner && rect_intersection(m_blits[i].area, touched, &overlap))
+                || (m_blits[i].source_owner == owner && rect_intersection(m_blits[i].source_area, touched, &overlap))) {
+            submit();
+            return;
+        }
+    }
+}
+
+bool_t BlitBatch::source_is_pending(surface_t surface) const
+{
+    Point origin;
+    surface_t owner = surface_get_owner(surface, &origin);
+    Rect area(origin, hw_surface_get_size(surface)), overlap;
+    for (size_t i = 0; i < m_blits.size(); i++)
+        if (m_blits[i].owner == owner && rect_intersection(m_blits[i].area, area, &overlap))
+            return EI_TRUE;
+    return EI_FALSE;
+}
+
+void BlitBatch::submit()
+{
+    if (m_blits.empty())
+        return;
+
+    // Consecutive blits with the same destination and blend mode are submitted together.
+    size_t first = 0;
+    while (first < m_blits.size()) {
+        size_t last = first + 1;
+        while (last < m_blits.size() && m_blits[last].destination == m_blits[first].destination
+                && m_blits[last].use_alpha == m_blits[first].use_alpha)
+            last++;
+
+#ifdef EI_HEADLESS
+        for (size_t i = first; i < last; i++)
+            copy_surface(m_blits[i].destination, m_blits[i].source, m_blits[i].where, m_blits[i].use_alpha);
+#else
+        RenderState& state = RenderState::getInstance();
+        state.set_target(m_blits[first].destination);
+        state.set_blender(m_blits[first].use_alpha == EI_TRUE ? ei_blend_premultiplied : ei_blend_copy);
+        state.set_clip(NULL);
+
+        // While drawing is held, Allegro merges the consecutive draws of one bitmap, or of the
+        // sub-bitmaps of one bitmap, in a single call.
+        al_hold_bitmap_drawing(true);
+        for (size_t i = first; i < last; i++)
+            al_draw_bitmap((ALLEGRO_BITMAP*) m_blits[i].source, m_blits[i].where.x, m_blits[i].where.y, 0);
+        al_hold_bitmap_drawing(false);
+#endif
+        m_stats.groups++;
+        first = last;
+    }
+
+    for (size_t i = 0; i < m_blits.size(); i++)
+        if (m_blits[i].owned == EI_TRUE)
+            hw_surface_free(m_blits[i].source);
+    m_blits.clear();
+}
+
+const blit_stats_t& BlitBatch::current_batch() const
+{
+    return m_stats;
+}
+
+const blit_stats_t& BlitBatch::last_batch() const
+{
+    return m_last;
 }
 
 }
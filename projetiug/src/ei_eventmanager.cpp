@@ -0,0 +1,70 @@
+#include "ei_eventmanager.h"
+
+namespace ei {
+
+typedef bool_t (*callback_function_t)(Widget*, Event*, void*);
+
+/**
+ * \brief   std::function cannot be compared: two callbacks are the same if they wrap the
+ *          same function, or objects of the same type (e.g. the same lambda).
+ */
+static bool same_callback(const ei_callback_t& c1, const ei_callback_t& c2)
+{
+    const callback_function_t* f1 = c1.target<callback_function_t>();
+    const callback_function_t* f2 = c2.target<callback_function_t>();
+    if (f1 != NULL && f2 != NULL)
+        return *f1 == *f2;
+    return c1.target_type() == c2.target_type();
+}
+
+EventManager::EventManager()
+{
+}
+
+void EventManager::bind(ei_eventtype_t eventtype,
+                        Widget*        widget,
+                        tag_t          tag,
+                        ei_callback_t  callback,
+                        void*          user_param)
+{
+    binding_t binding = {eventtype, widget, tag, callback, user_param};
+    bindings.push_back(binding);
+}
+
+void EventManager::unbind(ei_eventtype_t eventtype,
+                          Widget*        widget,
+                          tag_t          tag,
+                          ei_callback_t  callback,
+                          void*          user_param)
+{
+    for (std::vector<binding_t>::iterator it = bindings.begin(); it != bindings.end(); ++it) {
+        if (it->eventtype == eventtype && it->widget == widget && it->tag == tag
+                && it->user_param == user_param && same_callback(it->callback, callback)) {
+            bindings.erase(it);
+            return;
+        }
+    }
+}
+
+bool_t EventManager::handle(Event* event, Widget* widget)
+{
+    // Callbacks may bind or unbind while the event is processed.
+    std::vector<binding_t> current = bindings;
+
+    for (size_t i = 0; i < current.size(); i++) {
+        const binding_t& binding = current[i];
+        if (binding.eventtype != event->type)
+            continue;
+        if (binding.widget != NULL) {
+            if (binding.widget != widget)
+                continue;
+        } else if (binding.tag != "all" && (widget == NULL || binding.tag != widget->getName())) {
+            continue;
+        }
+        if (binding.callback(widget, event, binding.user_param) == EI_TRUE)
+            return EI_TRUE;
+    }
+    return EI_FALSE;
+}
+
+}
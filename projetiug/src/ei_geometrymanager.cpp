@@ -0,0 +1,185 @@
+#include "ei_geometrymanager.h"
+#include "ei_application.h"
+#include "ei_hitgrid.h"
+#include "ei_rendercache.h"
+#include "ei_configurebatch.h"
+
+namespace ei {
+
+GeometryManager::GeometryManager()
+{
+}
+
+GeometryManager::~GeometryManager()
+{
+}
+
+void GeometryManager::release(Widget* widget)
+{
+}
+
+void GeometryManager::unmap(Widget* widget)
+{
+    if (widget->geom_manager() == NULL)
+        return;
+
+    widget->geom_manager()->release(widget);
+    widget->geom_manager() = NULL;
+    HitGrid::getInstance().unmap(widget->handle);
+    RenderCache::getInstance().invalidate(widget);
+
+    if (Application::getInstance() != NULL)
+        Application::getInstance()->invalidate_geometry(widget->screen_location());
+    widget->screen_location() = Rect();
+    widget->content_rect() = Rect();
+}
+
+void Placer::run(Widget* widget)
+{
+    // Within a batch, the widget is placed once when it is committed.
+    if (ConfigureBatch::getInstance().defer_run(widget->handle) == EI_TRUE)
+        return;
+    WidgetStore::getInstance().order(widget->handle);
+    place(widget->index());
+}
+
+/**
+ * \brief   The screen location given by the placer parameters of a widget.
+ *
+ * @param   master      The content rectangle of the parent.
+ * @param   requested   The requested size of the widget, used when no size is given.
+ */
+static Rect placed_location(const placement_t& placement, const Rect& master, const Size& requested)
+{
+    // Absolute and relative sizes add up, the requested size is used when none is given.
+    float width = 0.f, height = 0.f;
+    if (placement.absolute_size.width >= 0.f)
+        width += placement.absolute_size.width;
+    if (placement.absolute_size.height >= 0.f)
+        height += placement.absolute_size.height;
+    width  += placement.relative_size.width  * master.size.width;
+    height += placement.relative_size.height * master.size.height;
+    if (placement.absolute_size.width < 0.f && placement.relative_size.width == 0.f)
+        width = requested.width;
+    if (placement.absolute_size.height < 0.f && placement.relative_size.height == 0.f)
+        height = requested.height;
+
+    int x = master.top_left.x + placement.absolute_pos.x + (int)(placement.relative_pos.width  * master.size.width);
+    int y = master.top_left.y + placement.absolute_pos.y + (int)(placement.relative_pos.height * master.size.height);
+    int w = (int)width, h = (int)height;
+
+    switch (placement.anchor) {
+    case ei_anc_north:      x -= w / 2;                 break;
+    case ei_anc_northeast:  x -= w;                     break;
+    case ei_anc_east:       x -= w;     y -= h / 2;     break;
+    case ei_anc_southeast:  x -= w;     y -= h;         break;
+    case ei_anc_south:      x -= w / 2; y -= h;         break;
+    case ei_anc_southwest:              y -= h;         break;
+    case ei_anc_west:                   y -= h / 2;     break;
+    case ei_anc_center:     x -= w / 2; y -= h / 2;     break;
+    default:                                            break;
+    }
+    return Rect(Point(x, y), Size(w, h));
+}
+
+void Placer::place(int index)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    if (store.parent(index) == WidgetStore::k_none)
+        return;
+    Application* app = Application::getInstance();
+
+    // The subtree is placed by a single forward scan: a parent precedes its descendants, so
+    // its content rectangle is up to date when they are reached. The subtrees of the widgets
+    // that are not managed by the placer are skipped. The hit grid entries only depend on the
+    // rectangles of the widget and on the entry of its parent: refresh_end is the end of the
+    // last subtree whose entry changed, below it every entry is updated.
+    HitGrid& grid = HitGrid::getInstance();
+    int refresh_end = index + 1, covered_end = index;
+    for (int i = index, end = store.end(index); i < end; ) {
+        Widget* widget = store.widget(i);
+        GeometryManager* manager = store.manager(i);
+        if (widget == NULL || manager == NULL) {
+            i = store.end(i);
+            continue;
+        }
+        if (manager != this) {
+            manager->run(widget);
+            i = store.end(i);
+            continue;
+        }
+
+        Rect location = placed_location(store.placement(i), store.content_rect(store.parent(i)),
+                                        widget->requested_size);
+        Rect previous = store.screen_location(i), previous_content = store.content_rect(i);
+        widget->geomnotify(location);
+        bool_t moved = rect_equal(previous, store.screen_location(i)) == EI_TRUE
+                       && rect_equal(previous_content, store.content_rect(i)) == EI_TRUE
+                       ? EI_FALSE : EI_TRUE;
+        if (moved == EI_TRUE || i < refresh_end || store.parent(store.parent(i)) == WidgetStore::k_none) {
+            if (grid.update(i) == EI_TRUE && store.end(i) > refresh_end)
+                refresh_end = store.end(i);
+        }
+
+        // Only the widgets that moved change the screen, the picking and the retained
+        // offscreens: the attributes are invalidated by configure. The rectangles of a moved
+        // widget cover its descendants, whose offscreens are dropped with its own.
+        if (moved == EI_TRUE && i >= covered_end) {
+            RenderCache::getInstance().invalidate(widget);
+            if (app != NULL) {
+                app->invalidate_geometry(previous);
+                app->invalidate_geometry(store.screen_location(i));
+            }
+            covered_end = store.end(i);
+        }
+        i++;
+    }
+}
+
+void Placer::configure(Widget*    widget,
+                       anchor_t*  anchor,
+                       int*       x,
+                       int*       y,
+                       int*       width,
+                       int*       height,
+                       float*     rel_x,
+                       float*     rel_y,
+                       float*     rel_width,
+                       float*     rel_height)
+{
+    if (widget->geom_manager() != this) {
+        if (widget->geom_manager() != NULL)
+            widget->geom_manager()->unmap(widget);
+        widget->geom_manager() = this;
+        placement_t& placement = widget->placement();
+        placement.anchor = ei_anc_northwest;
+        placement.absolute_pos = Point();
+        placement.absolute_size = Size(-1.f, -1.f);
+        placement.relative_pos = Size();
+        placement.relative_size = Size();
+    }
+
+    placement_t& placement = widget->placement();
+    if (anchor != NULL)
+        placement.anchor = *anchor;
+    if (x != NULL)
+        placement.absolute_pos.x = *x;
+    if (y != NULL)
+        placement.absolute_pos.y = *y;
+    if (width != NULL)
+        placement.absolute_size.width = *width;
+    if (height != NULL)
+        placement.absolute_size.height = *height;
+    if (rel_x != NULL)
+        placement.relative_pos.width = *rel_x;
+    if (rel_y != NULL)
+        placement.relative_pos.height = *rel_y;
+    if (rel_width != NULL)
+        placement.relative_size.width = *rel_width;
+    if (rel_height != NULL)
+        placement.relative_size.height = *rel_height;
+
+    run(widget);
+}
+
+}
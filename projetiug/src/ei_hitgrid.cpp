@@ -0,0 +1,190 @@
+#include "ei_hitgrid.h"
+#include "ei_widget.h"
+
+#include <algorithm>
+
+namespace ei {
+
+const int HitGrid::k_cell_size;
+
+HitGrid::HitGrid()
+    : m_columns(0), m_rows(0)
+{
+}
+
+HitGrid::entry_t& HitGrid::entry(WidgetStore::handle_t handle)
+{
+    if (handle >= m_entries.size()) {
+        entry_t empty;
+        empty.mapped = EI_FALSE;
+        empty.bounded = EI_FALSE;
+        empty.cells[0] = empty.cells[1] = 0;
+        empty.cells[2] = empty.cells[3] = -1;
+        m_entries.resize(handle + 1, empty);
+    }
+    return m_entries[handle];
+}
+
+bool_t HitGrid::update(int index)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    WidgetStore::handle_t handle = store.handle(index);
+    int parent = store.parent(index);
+    if (parent == WidgetStore::k_none) {
+        return set(handle, EI_TRUE, store.screen_location(index), store.content_rect(index));
+    }
+
+    // The roots are not placed by a geometry manager: they are updated with their children.
+    if (store.parent(parent) == WidgetStore::k_none)
+        update(parent);
+    const entry_t& master = entry(store.handle(parent));
+    if (master.mapped == EI_FALSE) {
+        return set(handle, EI_FALSE, Rect(), Rect());
+    }
+
+    Rect master_clip = master.clip, area, clip;
+    if (!rect_intersection(store.screen_location(index), master_clip, &area))
+        area = Rect();
+    if (!rect_intersection(store.content_rect(index), master_clip, &clip))
+        clip = Rect();
+    return set(handle, EI_TRUE, area, clip);
+}
+
+void HitGrid::unmap(WidgetStore::handle_t handle)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    store.order(handle);
+    int index = store.index(handle);
+    for (int i = index, end = store.end(index); i < end; i++)
+        if (store.widget(i) != NULL)
+            set(store.handle(i), EI_FALSE, Rect(), Rect());
+}
+
+void HitGrid::remove(WidgetStore::handle_t handle)
+{
+    if (handle < m_entries.size())
+        set(handle, EI_FALSE, Rect(), Rect());
+}
+
+bool_t HitGrid::set(WidgetStore::handle_t handle, bool_t mapped, const Rect& area, const Rect& clip)
+{
+    entry_t& current = entry(handle);
+    bool_t changed = (bool_t)(rect_equal(current.clip, clip) == EI_FALSE);
+    current.clip = clip;
+    if (current.mapped == mapped && rect_equal(current.area, area) == EI_TRUE)
+        return changed;
+
+    erase_cells(handle);
+    current.mapped = mapped;
+    current.area = area;
+    insert_cells(handle);
+    unbound(handle);
+    return EI_TRUE;
+}
+
+void HitGrid::unbound(WidgetStore::handle_t handle)
+{
+    // A recycled handle may be unbounded under an ancestor that is not: all of them are marked.
+    WidgetStore& store = WidgetStore::getInstance();
+    for (int h = (int)handle; h != WidgetStore::k_none; h = store.parent_handle(h))
+        entry(h).bounded = EI_FALSE;
+}
+
+const Rect& HitGrid::bounds(WidgetStore::handle_t handle)
+{
+    entry_t& current = entry(handle);
+    if (current.bounded == EI_TRUE)
+        return current.bounds;
+
+    WidgetStore& store = WidgetStore::getInstance();
+    Rect box = current.mapped == EI_TRUE ? current.area : Rect();
+    for (int child = store.first_child(handle); child != WidgetStore::k_none; child = store.next_sibling(child))
+        box = rect_union(box, bounds(child));
+
+    // The entries may have grown with the children.
+    entry_t& computed = m_entries[handle];
+    computed.bounds = box;
+    computed.bounded = EI_TRUE;
+    return computed.bounds;
+}
+
+void HitGrid::erase_cells(WidgetStore::handle_t handle)
+{
+    const int* cells = m_entries[handle].cells;
+    for (int row = cells[1]; row <= cells[3]; row++) {
+        for (int column = cells[0]; column <= cells[2]; column++) {
+            std::vector<WidgetStore::handle_t>& cell = m_cells[row * m_columns + column];
+            for (size_t i = 0; i < cell.size(); i++) {
+                if (cell[i] == handle) {
+                    cell[i] = cell.back();
+                    cell.pop_back();
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void HitGrid::insert_cells(WidgetStore::handle_t handle)
+{
+    entry_t& current = m_entries[handle];
+    const Rect& area = current.area;
+    int x1 = area.top_left.x + (int)area.size.width - 1;
+    int y1 = area.top_left.y + (int)area.size.height - 1;
+
+    // The grid covers the positive quadrant, where the root window is.
+    if (current.mapped == EI_FALSE || area.size.width <= 0 || area.size.height <= 0 || x1 < 0 || y1 < 0) {
+        current.cells[0] = current.cells[1] = 0;
+        current.cells[2] = current.cells[3] = -1;
+        return;
+    }
+    current.cells[0] = std::max(area.top_left.x, 0) / k_cell_size;
+    current.cells[1] = std::max(area.top_left.y, 0) / k_cell_size;
+    current.cells[2] = x1 / k_cell_size;
+    current.cells[3] = y1 / k_cell_size;
+
+    // The grid grows with the areas, its cells keep their place.
+    if (current.cells[2] >= m_columns || current.cells[3] >= m_rows) {
+        int columns = std::max(m_columns, current.cells[2] + 1);
+        int rows = std::max(m_rows, current.cells[3] + 1);
+        std::vector<std::vector<WidgetStore::handle_t> > cells(columns * rows);
+        for (int row = 0; row < m_rows; row++)
+            for (int column = 0; column < m_columns; column++)
+                cells[row * columns + column].swap(m_cells[row * m_columns + column]);
+        m_cells.swap(cells);
+        m_columns = columns;
+        m_rows = rows;
+    }
+
+    for (int row = current.cells[1]; row <= current.cells[3]; row++)
+        for (int column = current.cells[0]; column <= current.cells[2]; column++)
+            m_cells[row * m_columns + column].push_back(handle);
+}
+
+Widget* HitGrid::hit(WidgetStore::handle_t handle, const Point& where)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    store.order(handle);
+    int first = store.index(handle), end = store.end(first);
+    if (store.parent(first) == WidgetStore::k_none)
+        update(first);
+
+    if (where.x < 0 || where.y < 0 || where.x / k_cell_size >= m_columns || where.y / k_cell_size >= m_rows)
+        return NULL;
+
+    // The widgets are drawn in the order of the store: the last one is on top.
+    int top = -1;
+    const std::vector<WidgetStore::handle_t>& cell = m_cells[(where.y / k_cell_size) * m_columns + where.x / k_cell_size];
+    for (size_t i = 0; i < cell.size(); i++) {
+        if (!rect_contains(m_entries[cell[i]].area, where))
+            continue;
+        int index = store.index(cell[i]);
+        if (index < first || index >= end || index <= top)
+            continue;
+        if (store.widget(index)->contains(where) == EI_TRUE)
+            top = index;
+    }
+    return top >= 0 ? store.widget(top) : NULL;
+}
+
+}
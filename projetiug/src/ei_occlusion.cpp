@@ -0,0 +1,148 @@
+#include "ei_occlusion.h"
+#include "ei_widget.h"
+#include "ei_hitgrid.h"
+
+#include <algorithm>
+
+namespace ei {
+
+const int OcclusionCuller::k_max_occluders;
+
+OcclusionCuller::OcclusionCuller()
+    : m_first(WidgetStore::k_none)
+{
+}
+
+/**
+ * \brief   Tells if a rectangle is covered by the union of some rectangles: the parts out of
+ *          the first one that overlaps it must be covered by the next ones.
+ */
+static bool_t rect_covered(const Rect& rect, const Rect* occluders, int count)
+{
+    for (int k = 0; k < count; k++) {
+        Rect overlap;
+        if (!rect_intersection(rect, occluders[k], &overlap))
+            continue;
+        if (rect_equal(overlap, rect) == EI_TRUE)
+            return EI_TRUE;
+
+        int x0 = rect.top_left.x, y0 = rect.top_left.y;
+        int x1 = x0 + (int)rect.size.width, y1 = y0 + (int)rect.size.height;
+        int ox0 = overlap.top_left.x, oy0 = overlap.top_left.y;
+        int ox1 = ox0 + (int)overlap.size.width, oy1 = oy0 + (int)overlap.size.height;
+        Rect parts[4] = {
+            Rect(Point(x0, y0),   Size(x1 - x0, oy0 - y0)),     // Above.
+            Rect(Point(x0, oy1),  Size(x1 - x0, y1 - oy1)),     // Below.
+            Rect(Point(x0, oy0),  Size(ox0 - x0, oy1 - oy0)),   // Left.
+            Rect(Point(ox1, oy0), Size(x1 - ox1, oy1 - oy0))    // Right.
+        };
+        for (int i = 0; i < 4; i++)
+            if (parts[i].size.width > 0 && parts[i].size.height > 0
+                    && rect_covered(parts[i], occluders + k + 1, count - k - 1) == EI_FALSE)
+                return EI_FALSE;
+        return EI_TRUE;
+    }
+    return EI_FALSE;
+}
+
+void OcclusionCuller::prepare(Widget* root, const Rect& area)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    HitGrid& grid = HitGrid::getInstance();
+    store.order(root->handle);
+    m_first = root->index();
+    int end = store.end(m_first);
+    m_states.assign(end - m_first, ei_occluded_none);
+    m_clips.resize(end - m_first);
+    m_visible.clear();
+    m_occluders.clear();
+
+    // The visible areas are clipped by the ancestors, and the subtrees out of the rectangle are
+    // skipped by their bounds, as when drawing.
+    for (int i = m_first; i < end; ) {
+        if (store.widget(i) == NULL || (i != m_first && store.manager(i) == NULL)) {
+            i = store.end(i);
+            continue;
+        }
+        int k = i - m_first;
+        const Rect& parent_clip = i == m_first ? area : m_clips[store.parent(i) - m_first];
+        Rect bounds;
+        if (i != m_first && !rect_intersection(grid.bounds(store.handle(i)), parent_clip, &bounds)) {
+            i = store.end(i);
+            continue;
+        }
+        visible_t visible = {Rect(), i};
+        if (rect_intersection(store.screen_location(i), parent_clip, &visible.area) == EI_TRUE)
+            m_visible.push_back(visible);
+        m_clips[k] = Rect();
+        if (rect_intersection(store.content_rect(i), parent_clip, &m_clips[k]) == EI_TRUE)
+            i++;
+        else
+            i = store.end(i);
+    }
+
+    // The widgets drawn last are walked first.
+    for (int v = (int)m_visible.size() - 1; v >= 0; v--) {
+        const Rect& visible = m_visible[v].area;
+        int i = m_visible[v].index, k = i - m_first;
+
+        // The descendants are drawn within the clip of the widget.
+        int subtree_end = store.end(i);
+        const Rect& clip = m_clips[k];
+        bool_t clip_covered = clip.size.width <= 0 || clip.size.height <= 0
+                            ? EI_TRUE : covered(clip, subtree_end - 1);
+        if (clip_covered == EI_TRUE && covered(visible, subtree_end - 1) == EI_TRUE)
+            std::fill(m_states.begin() + k, m_states.begin() + subtree_end - m_first, ei_occluded_subtree);
+        else if (covered(visible, i) == EI_TRUE)
+            m_states[k] = ei_occluded_widget;
+
+        Rect opaque, hidden;
+        if (store.widget(i)->opaque(&opaque) == EI_TRUE && rect_intersection(opaque, visible, &hidden))
+            add_occluder(hidden, i);
+    }
+}
+
+void OcclusionCuller::finish()
+{
+    m_first = WidgetStore::k_none;
+}
+
+occlusion_t OcclusionCuller::occluded(const Widget* widget) const
+{
+    if (m_first == WidgetStore::k_none)
+        return ei_occluded_none;
+    int k = widget->index() - m_first;
+    if (k < 0 || k >= (int)m_states.size())
+        return ei_occluded_none;
+    return (occlusion_t)m_states[k];
+}
+
+void OcclusionCuller::add_occluder(const Rect& area, int index)
+{
+    occluder_t occluder = {area, index};
+    if ((int)m_occluders.size() < k_max_occluders) {
+        m_occluders.push_back(occluder);
+        return;
+    }
+
+    // Many small widgets hide less than a few large ones, and would slow down the walk.
+    size_t smallest = 0;
+    for (size_t i = 1; i < m_occluders.size(); i++)
+        if (m_occluders[i].area.size.width * m_occluders[i].area.size.height
+                < m_occluders[smallest].area.size.width * m_occluders[smallest].area.size.height)
+            smallest = i;
+    if (area.size.width * area.size.height > m_occluders[smallest].area.size.width * m_occluders[smallest].area.size.height)
+        m_occluders[smallest] = occluder;
+}
+
+bool_t OcclusionCuller::covered(const Rect& rect, int after) const
+{
+    Rect occluders[k_max_occluders];
+    int count = 0;
+    for (size_t i = 0; i < m_occluders.size(); i++)
+        if (m_occluders[i].index > after)
+            occluders[count++] = m_occluders[i].area;
+    return rect_covered(rect, occluders, count);
+}
+
+}
@@ -0,0 +1,171 @@
+#include "ei_rendercache.h"
+#include "ei_widget.h"
+#include "ei_draw.h"
+
+#include <string.h>
+
+namespace ei {
+
+const size_t RenderCache::k_default_budget;
+
+RenderCache::RenderCache()
+    : m_capturing(NULL), m_newest(WidgetStore::k_none), m_oldest(WidgetStore::k_none),
+      m_budget(k_default_budget)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+void RenderCache::draw(Widget* widget, surface_t surface, IdBuffer* pick_buffer, Rect* clipper)
+{
+    const Rect location = widget->screen_location();
+    Rect visible = location;
+    if (clipper != NULL && !rect_intersection(*clipper, location, &visible))
+        return;
+
+    // The ids are not kept, they are only drawn where the geometry changed.
+    if (pick_buffer != NULL) {
+        widget->draw(surface, pick_buffer, clipper);
+        return;
+    }
+
+    WidgetStore::handle_t handle = widget->handle;
+    if (handle >= m_entries.size()) {
+        entry_t empty = {NULL, Point(), WidgetStore::k_none, WidgetStore::k_none};
+        m_entries.resize(handle + 1, empty);
+    }
+    entry_t& entry = m_entries[handle];
+
+    if (entry.surface != NULL && entry.where.x == location.top_left.x && entry.where.y == location.top_left.y
+            && rect_equal(hw_surface_get_rect(entry.surface), Rect(Point(), location.size)) == EI_TRUE) {
+        Rect part(visible.top_left - location.top_left, visible.size);
+        BlitBatch::getInstance().add(surface, create_surface_view(entry.surface, &part), visible.top_left,
+                                     EI_FALSE, EI_TRUE);
+        unlink(handle);
+        link(handle);
+        m_stats.hits++;
+    } else {
+        m_stats.misses++;
+        drop(handle);
+
+        // Only a widget drawn entirely can be captured, and only if it hides its background:
+        // the background is not invalidated with it.
+        size_t bytes = (size_t)location.size.width * (size_t)location.size.height * 4;
+        Rect covered;
+        if (rect_equal(visible, location) == EI_FALSE || bytes == 0 || bytes > m_budget
+                || widget->opaque(&covered) == EI_FALSE || rect_equal(covered, location) == EI_FALSE) {
+            widget->draw(surface, NULL, clipper);
+            return;
+        }
+
+        m_capturing = widget->retained == ei_retain_widget ? widget : NULL;
+        widget->draw(surface, NULL, clipper);
+        m_capturing = NULL;
+
+        // The widget is opaque: its offscreen needs no alpha.
+        Rect area = location;
+        entry.surface = create_surface(surface, &location.size, ei_format_rgbx8888);
+        entry.where = location.top_left;
+        link(handle);
+        // The capture reads the target, it is submitted before the next widgets draw over it.
+        BlitBatch::getInstance().add(entry.surface, create_surface_view(surface, &area), Point(),
+                                     EI_FALSE, EI_TRUE);
+        BlitBatch::getInstance().submit();
+        m_stats.bytes += bytes;
+        m_stats.entries++;
+    }
+
+    // The children of a widget retained alone are drawn over its offscreen.
+    if (widget->retained == ei_retain_widget)
+        widget->Widget::draw(surface, NULL, clipper);
+}
+
+void RenderCache::invalidate(Widget* widget)
+{
+    if (m_stats.entries == 0)
+        return;
+
+    WidgetStore& store = WidgetStore::getInstance();
+    store.order(widget->handle);
+    int index = widget->index();
+    for (int i = index, end = store.end(index); i < end; i++)
+        if (store.widget(i) != NULL)
+            drop(store.handle(i));
+    for (int i = store.parent(index); i != WidgetStore::k_none; i = store.parent(i))
+        if (store.widget(i)->retained == ei_retain_subtree)
+            drop(store.handle(i));
+}
+
+void RenderCache::remove(WidgetStore::handle_t handle)
+{
+    drop(handle);
+}
+
+void RenderCache::drop(WidgetStore::handle_t handle)
+{
+    if (handle >= m_entries.size() || m_entries[handle].surface == NULL)
+        return;
+
+    entry_t& entry = m_entries[handle];
+    Size size = hw_surface_get_size(entry.surface);
+    m_stats.bytes -= (size_t)size.width * (size_t)size.height * 4;
+    m_stats.entries--;
+    m_released.push_back(entry.surface);
+    entry.surface = NULL;
+    unlink(handle);
+}
+
+void RenderCache::link(WidgetStore::handle_t handle)
+{
+    entry_t& entry = m_entries[handle];
+    entry.newer = WidgetStore::k_none;
+    entry.older = m_newest;
+    if (m_newest != WidgetStore::k_none)
+        m_entries[m_newest].newer = (int)handle;
+    else
+        m_oldest = (int)handle;
+    m_newest = (int)handle;
+}
+
+void RenderCache::unlink(WidgetStore::handle_t handle)
+{
+    entry_t& entry = m_entries[handle];
+    if (entry.newer != WidgetStore::k_none)
+        m_entries[entry.newer].older = entry.older;
+    else
+        m_newest = entry.older;
+    if (entry.older != WidgetStore::k_none)
+        m_entries[entry.older].newer = entry.newer;
+    else
+        m_oldest = entry.newer;
+    entry.newer = entry.older = WidgetStore::k_none;
+}
+
+void RenderCache::trim()
+{
+    // The least recently used offscreens are dropped first.
+    while (m_stats.bytes > m_budget) {
+        drop((WidgetStore::handle_t)m_oldest);
+        m_stats.evictions++;
+    }
+
+    for (size_t i = 0; i < m_released.size(); i++)
+        hw_surface_free(m_released[i]);
+    m_released.clear();
+}
+
+void RenderCache::set_budget(size_t bytes)
+{
+    m_budget = bytes;
+}
+
+size_t RenderCache::budget() const
+{
+    return m_budget;
+}
+
+const render_cache_stats_t& RenderCache::stats() const
+{
+    return m_stats;
+}
+
+}
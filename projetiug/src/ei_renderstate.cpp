@@ -0,0 +1,114 @@
+#include "ei_renderstate.h"
+
+#include <string.h>
+
+#ifndef EI_HEADLESS
+#include <allegro5/allegro5.h>
+#endif
+
+namespace ei {
+
+RenderState::RenderState()
+    : m_target(NULL), m_blender(ei_blend_none), m_clip_valid(EI_FALSE), m_clipped(EI_FALSE)
+{
+    memset(&m_current, 0, sizeof(m_current));
+    memset(&m_last, 0, sizeof(m_last));
+}
+
+void RenderState::set_target(surface_t surface)
+{
+#ifndef EI_HEADLESS
+    // The hw_* functions set the target of the backend too, check that it is still ours.
+    if (surface == m_target && al_get_target_bitmap() == (ALLEGRO_BITMAP*) surface) {
+#else
+    if (surface == m_target) {
+#endif
+        m_current.target_avoided++;
+        return;
+    }
+
+#ifndef EI_HEADLESS
+    al_set_target_bitmap((ALLEGRO_BITMAP*) surface);
+#endif
+    m_target = surface;
+    m_clip_valid = EI_FALSE;
+    m_current.target_changes++;
+}
+
+void RenderState::set_blender(blend_t blender)
+{
+    if (blender == m_blender) {
+        m_current.blender_avoided++;
+        return;
+    }
+
+#ifndef EI_HEADLESS
+    switch (blender) {
+    case ei_blend_copy:
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO);
+        break;
+    case ei_blend_alpha:
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ALPHA, ALLEGRO_INVERSE_ALPHA);
+        break;
+    default:
+        al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+        break;
+    }
+#endif
+    m_blender = blender;
+    m_current.blender_changes++;
+}
+
+void RenderState::set_clip(const Rect* clipper)
+{
+    if (m_clip_valid == EI_TRUE) {
+        if (clipper == NULL && m_clipped == EI_FALSE) {
+            m_current.clip_avoided++;
+            return;
+        }
+        if (clipper != NULL && m_clipped == EI_TRUE
+                && clipper->top_left.x == m_clip.top_left.x && clipper->top_left.y == m_clip.top_left.y
+                && clipper->size.width == m_clip.size.width && clipper->size.height == m_clip.size.height) {
+            m_current.clip_avoided++;
+            return;
+        }
+    }
+
+#ifndef EI_HEADLESS
+    if (clipper == NULL)
+        al_reset_clipping_rectangle();
+    else
+        al_set_clipping_rectangle(clipper->top_left.x, clipper->top_left.y,
+                                  clipper->size.width, clipper->size.height);
+#endif
+    m_clip_valid = EI_TRUE;
+    m_clipped = clipper != NULL ? EI_TRUE : EI_FALSE;
+    if (clipper != NULL)
+        m_clip = *clipper;
+    m_current.clip_changes++;
+}
+
+void RenderState::invalidate()
+{
+    m_target = NULL;
+    m_blender = ei_blend_none;
+    m_clip_valid = EI_FALSE;
+}
+
+void RenderState::begin_frame()
+{
+    m_last = m_current;
+    memset(&m_current, 0, sizeof(m_current));
+}
+
+const render_stats_t& RenderState::last_frame() const
+{
+    return m_last;
+}
+
+const render_stats_t& RenderState::current_frame() const
+{
+    return m_current;
+}
+
+}
@@ -0,0 +1,813 @@
+#include "ei_widget.h"
+#include "ei_application.h"
+#include "ei_geometrymanager.h"
+#include "ei_eventmanager.h"
+#include "ei_hitgrid.h"
+#include "ei_rendercache.h"
+#include "ei_occlusion.h"
+#include "ei_configurebatch.h"
+
+#include <stdlib.h>
+#include <algorithm>
+
+namespace ei {
+
+Widget::Widget(const widgetclass_name_t& class_name, Widget* parent)
+    : name(class_name), retained(ei_retain_none)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    handle = store.insert(this, parent != NULL ? parent->handle : 0, parent == NULL ? EI_TRUE : EI_FALSE);
+    pick_id = store.pick_id(handle);
+}
+
+Widget::~Widget()
+{
+    if (geom_manager() != NULL)
+        geom_manager()->unmap(this);
+
+    // The children are removed from the store before their parent.
+    WidgetStore& store = WidgetStore::getInstance();
+    while (store.first_child(handle) != WidgetStore::k_none)
+        delete store.widget(store.index(store.first_child(handle)));
+
+    HitGrid::getInstance().remove(handle);
+    RenderCache::getInstance().remove(handle);
+    ConfigureBatch::getInstance().remove(handle);
+    store.remove(handle);
+}
+
+void Widget::draw(surface_t surface, IdBuffer* pick_buffer, Rect* clipper)
+{
+    Rect clip = content_rect();
+    if (clipper != NULL && !rect_intersection(*clipper, clip, &clip))
+        return;
+
+    // The children of a widget retained alone are not in its offscreen.
+    RenderCache& cache = RenderCache::getInstance();
+    if (cache.capturing(this) == EI_TRUE)
+        return;
+
+    WidgetStore& store = WidgetStore::getInstance();
+    OcclusionCuller& culler = OcclusionCuller::getInstance();
+    HitGrid& grid = HitGrid::getInstance();
+    store.order(handle);
+    for (int i = index() + 1; i < store.end(index()); i = store.end(i)) {
+        Widget* child = store.widget(i);
+        if (child == NULL || store.manager(i) == NULL)
+            continue;
+
+        // The subtrees out of the clip are skipped without visiting them.
+        Rect bounds;
+        if (!rect_intersection(grid.bounds(store.handle(i)), clip, &bounds))
+            continue;
+        occlusion_t occluded = culler.occluded(child);
+        if (occluded == ei_occluded_subtree)
+            continue;
+        if (occluded == ei_occluded_widget)
+            child->Widget::draw(surface, pick_buffer, &clip);
+        else if (child->retained != ei_retain_none)
+            cache.draw(child, surface, pick_buffer, &clip);
+        else
+            child->draw(surface, pick_buffer, &clip);
+    }
+}
+
+void Widget::geomnotify(Rect rect)
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    int i = index();
+    store.screen_location(i) = rect;
+    store.content_rect(i) = rect;
+}
+
+Widget* Widget::pick(uint32_t id)
+{
+    // The widget of the id, if it is in the subtree of this one.
+    WidgetStore& store = WidgetStore::getInstance();
+    Widget* widget = store.resolve(id);
+    if (widget == NULL)
+        return NULL;
+    store.order(handle);
+    int i = widget->index();
+    return i >= index() && i < store.end(index()) ? widget : NULL;
+}
+
+Widget* Widget::pick(const Point& where)
+{
+    return HitGrid::getInstance().hit(handle, where);
+}
+
+bool_t Widget::contains(const Point& where) const
+{
+    return rect_contains(screen_location(), where);
+}
+
+bool_t Widget::opaque(Rect* area) const
+{
+    return EI_FALSE;
+}
+
+void Widget::set_retained(retain_t retain)
+{
+    retained = retain;
+    RenderCache::getInstance().remove(handle);
+}
+
+void Widget::invalidate(int dirty)
+{
+    if (dirty == ei_dirty_none)
+        return;
+
+    // The geometry manager redraws the widget where it was and where it goes, if it moves.
+    if ((dirty & ei_dirty_layout) != 0 && geom_manager() != NULL)
+        geom_manager()->run(this);
+    RenderCache::getInstance().invalidate(this);
+
+    Application* app = Application::getInstance();
+    if (app == NULL)
+        return;
+    if ((dirty & ei_dirty_pick) != 0)
+        app->invalidate_geometry(screen_location());
+    else if ((dirty & ei_dirty_paint) != 0)
+        app->invalidate_rect(screen_location());
+}
+
+uint32_t Widget::getPick_id() const
+{
+    return pick_id;
+}
+
+Widget* Widget::getParent() const
+{
+    WidgetStore& store = WidgetStore::getInstance();
+    int parent = store.parent(index());
+    return parent != WidgetStore::k_none ? store.widget(parent) : NULL;
+}
+
+const Rect* Widget::getContent_rect() const
+{
+    return &WidgetStore::getInstance().content_rect(index());
+}
+
+const widgetclass_name_t& Widget::getName() const
+{
+    return name;
+}
+
+static color_t shade(const color_t& color, float factor)
+{
+    color_t shaded = color;
+    if (factor > 1.f) {
+        shaded.red   = color.red   + (255 - color.red)   * (factor - 1.f);
+        shaded.green = color.green + (255 - color.green) * (factor - 1.f);
+        shaded.blue  = color.blue  + (255 - color.blue)  * (factor - 1.f);
+    } else {
+        shaded.red   = color.red   * factor;
+        shaded.green = color.green * factor;
+        shaded.blue  = color.blue  * factor;
+    }
+    return shaded;
+}
+
+/**
+ * \brief   Draws a rectangle with a border in relief: the top-left half of the border is
+ *          lighter than the background and the bottom-right half darker for a raised
+ *          relief, the other way round for a sunken relief. The id is written on the whole
+ *          rectangle of "ids" with its first fill.
+ */
+static void draw_relief_rect(surface_t surface, IdBuffer* ids, const Rect& rect, const color_t& color,
+                             int border_width, relief_t relief, uint32_t id, const Rect* clipper)
+{
+    if (relief == ei_relief_none || border_width <= 0) {
+        fill_rounded_rect(surface, ids, rect, 0, color, id, clipper);
+        return;
+    }
+
+    color_t light = shade(color, 1.5f);
+    color_t dark  = shade(color, 0.5f);
+    if (relief == ei_relief_sunken) {
+        color_t tmp = light;
+        light = dark;
+        dark = tmp;
+    }
+
+    fill_rounded_rect(surface, ids, rect, 0, dark, id, clipper);
+
+    int x = rect.top_left.x, y = rect.top_left.y;
+    int w = rect.size.width, h = rect.size.height;
+    int half = (w < h ? w : h) / 2;
+    linked_point_t points[5];
+    points[0].point = Point(x, y);
+    points[1].point = Point(x + w - 1, y);
+    points[2].point = Point(x + w - 1 - half, y + half);
+    points[3].point = Point(x + half, y + h - half);
+    points[4].point = Point(x, y + h);
+    for (int i = 0; i < 4; i++)
+        points[i].next = &points[i + 1];
+    points[4].next = NULL;
+    draw_polygon(surface, points, light, clipper);
+
+    Rect inner(Point(x + border_width, y + border_width),
+               Size(w - 2 * border_width, h - 2 * border_width));
+    fill_rounded_rect(surface, inner, 0, color, clipper);
+}
+
+/**
+ * \brief   Computes where to place a content of some size inside a container.
+ */
+static Point anchored_position(const Rect& container, const Size& size, anchor_t anchor)
+{
+    int x = container.top_left.x, y = container.top_left.y;
+    int dw = container.size.width - size.width;
+    int dh = container.size.height - size.height;
+
+    switch (anchor) {
+    case ei_anc_northwest:                          break;
+    case ei_anc_north:      x += dw / 2;            break;
+    case ei_anc_northeast:  x += dw;                break;
+    case ei_anc_east:       x += dw;    y += dh / 2; break;
+    case ei_anc_southeast:  x += dw;    y += dh;    break;
+    case ei_anc_south:      x += dw / 2; y += dh;   break;
+    case ei_anc_southwest:              y += dh;    break;
+    case ei_anc_west:                   y += dh / 2; break;
+    default:                x += dw / 2; y += dh / 2; break;
+    }
+    return Point(x, y);
+}
+
+Frame::Frame(Widget* parent)
+    : Frame("frame", parent)
+{
+}
+
+Frame::Frame(const widgetclass_name_t& class_name, Widget* parent)
+    : Widget(class_name, parent), color(ei_default_background_color), border_width(0),
+      relief(ei_relief_none), text_color(ei_font_default_color),
+      text_anchor(ei_anc_center), img_rect(NULL), img_anchor(ei_anc_center),
+      size_requested(EI_FALSE)
+{
+}
+
+Frame::~Frame()
+{
+    delete img_rect;
+}
+
+void Frame::draw(surface_t surface, IdBuffer* pick_buffer, Rect* clipper)
+{
+    const Rect location = screen_location();
+    Rect clip = location;
+    if (clipper != NULL && !rect_intersection(*clipper, location, &clip))
+        return;
+
+    draw_relief_rect(surface, pick_buffer, location, color, border_width, relief, pick_id, &clip);
+
+    Rect inner(location.top_left + Point(border_width, border_width),
+               location.size - Size(2 * border_width, 2 * border_width));
+    draw_content(surface, inner, clip);
+
+    Widget::draw(surface, pick_buffer, clipper);
+}
+
+bool_t Frame::opaque(Rect* area) const
+{
+    // The relief is shaded from the background color, with its transparency.
+    if (color.alpha != 0xff)
+        return EI_FALSE;
+    *area = screen_location();
+    return EI_TRUE;
+}
+
+void Frame::draw_content(surface_t surface, const Rect& inner, const Rect& clip)
+{
+    Rect visible;
+
+    if (!text.empty()) {
+        font_t font = text_font.empty() ? ei_default_font : text_font.get();
+        Size size;
+        hw_text_compute_size(text.c_str(), font, size);
+        Point where = anchored_position(inner, size, text_anchor);
+        if (rect_intersection(Rect(where, size), clip, &visible))
+            draw_text(surface, &where, text.c_str(), font, &text_color);
+    } else if (img.empty() == EI_FALSE) {
+        Size size = img_rect != NULL ? img_rect->size : hw_surface_get_size(img.get());
+        Point where = anchored_position(inner, size, img_anchor);
+        if (rect_intersection(Rect(where, size), clip, &visible)) {
+            if (img_rect == NULL) {
+                ei_copy_surface(surface, img.get(), &where, EI_TRUE);
+            } else {
+                // The displayed part of the image, freed once it has been drawn.
+                Rect part_rect;
+                if (rect_intersection(*img_rect, hw_surface_get_rect(img.get()), &part_rect)) {
+                    surface_t part = create_surface_view(img.get(), &part_rect);
+                    BlitBatch::getInstance().add(surface, part, where + part_rect.top_left - img_rect->top_left,
+                                                 EI_TRUE, EI_TRUE);
+                }
+            }
+        }
+    }
+}
+
+void Frame::configure(Size*           requested_size,
+                      const color_t*  color,
+                      int*            border_width,
+                      relief_t*       relief,
+                      char**          text,
+                      font_t*         text_font,
+                      color_t*        text_color,
+                      anchor_t*       text_anchor,
+                      surface_t*      img,
+                      Rect**          img_rect,
+                      anchor_t*       img_anchor)
+{
+    // The caller keeps the ownership of the font and of the image.
+    Font font = text_font != NULL ? Font::borrow(*text_font) : Font();
+    Surface image = img != NULL ? Surface::borrow(*img) : Surface();
+    configure_shared(requested_size, color, border_width, relief, text,
+                     text_font != NULL ? &font : NULL, text_color, text_anchor,
+                     img != NULL ? &image : NULL, img_rect, img_anchor);
+}
+
+void Frame::configure_shared(Size*           requested_size,
+                             const color_t*  color,
+                             int*            border_width,
+                             relief_t*       relief,
+                             char**          text,
+                             const Font*     text_font,
+                             color_t*        text_color,
+                             anchor_t*       text_anchor,
+                             const Surface*  img,
+                             Rect**          img_rect,
+                             anchor_t*       img_anchor)
+{
+    configure_frame(requested_size, color, border_width, relief, text, text_font, text_color,
+                    text_anchor, img, img_rect, img_anchor);
+}
+
+void Frame::configure_frame(Size*              requested_size,
+                            const color_t*     color,
+                            int*               border_width,
+                            relief_t*          relief,
+                            const char* const* text,
+                            const Font*        text_font,
+                            color_t*           text_color,
+                            anchor_t*          text_anchor,
+                            const Surface*     img,
+                            Rect**             img_rect,
+                            anchor_t*          img_anchor,
+                            int                dirty)
+{
+    // Only the changes of the requested size are placed again, the others are repainted.
+    if (color != NULL && color_equal(*color, this->color) == EI_FALSE) {
+        this->color = *color;
+        dirty |= ei_dirty_paint;
+    }
+    if (border_width != NULL && *border_width != this->border_width) {
+        this->border_width = *border_width;
+        dirty |= ei_dirty_paint;
+    }
+    if (relief != NULL && *relief != this->relief) {
+        this->relief = *relief;
+        dirty |= ei_dirty_paint;
+    }
+    if (text != NULL && this->text != (*text != NULL ? *text : "")) {
+        this->text = *text != NULL ? *text : "";
+        dirty |= ei_dirty_paint;
+    }
+    if (text_font != NULL && text_font->get() != this->text_font.get()) {
+        this->text_font = *text_font;
+        dirty |= ei_dirty_paint;
+    }
+    if (text_color != NULL && color_equal(*text_color, this->text_color) == EI_FALSE) {
+        this->text_color = *text_color;
+        dirty |= ei_dirty_paint;
+    }
+    if (text_anchor != NULL && *text_anchor != this->text_anchor) {
+        this->text_anchor = *text_anchor;
+        dirty |= ei_dirty_paint;
+    }
+    if (img != NULL && img->get() != this->img.get()) {
+        this->img = *img;
+        dirty |= ei_dirty_paint;
+    }
+    if (img_rect != NULL && (*img_rect == NULL ? this->img_rect != NULL
+                             : this->img_rect == NULL || rect_equal(**img_rect, *this->img_rect) == EI_FALSE)) {
+        delete this->img_rect;
+        this->img_rect = *img_rect != NULL ? new Rect(**img_rect) : NULL;
+        dirty |= ei_dirty_paint;
+    }
+    if (img_anchor != NULL && *img_anchor != this->img_anchor) {
+        this->img_anchor = *img_anchor;
+        dirty |= ei_dirty_paint;
+    }
+
+    Size previous_size = this->requested_size;
+    if (requested_size != NULL) {
+        this->requested_size = *requested_size;
+        size_requested = EI_TRUE;
+    } else if (size_requested == EI_FALSE) {
+        Size natural;
+        if (!this->text.empty())
+            hw_text_compute_size(this->text.c_str(),
+                                 this->text_font.empty() ? ei_default_font : this->text_font.get(), natural);
+        else if (this->img_rect != NULL)
+            natural = this->img_rect->size;
+        else if (this->img.empty() == EI_FALSE)
+            natural = hw_surface_get_size(this->img.get());
+        this->requested_size = natural + Size(2 * this->border_width, 2 * this->border_width);
+    }
+    if (this->requested_size.width != previous_size.width || this->requested_size.height != previous_size.height)
+        dirty |= ei_dirty_layout;
+
+    invalidate(dirty);
+}
+
+Button::Button(Widget* parent)
+    : Frame("button", parent), corner_radius(ei_default_button_corner_radius), pressed(EI_FALSE)
+{
+    border_width = ei_default_button_border_width;
+    relief = ei_relief_raised;
+
+    EventManager::getInstance().bind(ei_ev_mouse_buttondown, this, "", on_buttondown, this);
+    EventManager::getInstance().bind(ei_ev_mouse_buttonup, NULL, "all", on_buttonup, this);
+}
+
+Button::~Button()
+{
+    EventManager::getInstance().unbind(ei_ev_mouse_buttondown, this, "", on_buttondown, this);
+    EventManager::getInstance().unbind(ei_ev_mouse_buttonup, NULL, "all", on_buttonup, this);
+}
+
+void Button::draw(surface_t surface, IdBuffer* pick_buffer, Rect* clipper)
+{
+    const Rect location = screen_location();
+    Rect clip = location;
+    if (clipper != NULL && !rect_intersection(*clipper, location, &clip))
+        return;
+
+    // The relief is inverted while the button is pressed.
+    relief_t shown = relief;
+    if (pressed == EI_TRUE && relief != ei_relief_none)
+        shown = relief == ei_relief_raised ? ei_relief_sunken : ei_relief_raised;
+
+    Rect inner(location.top_left + Point(border_width, border_width),
+               location.size - Size(2 * border_width, 2 * border_width));
+
+    if (shown == ei_relief_none || border_width <= 0) {
+        // Without a relief, the face has the pick shape: both are written in one pass.
+        fill_rounded_rect(surface, pick_buffer, location, corner_radius, color, pick_id, &clip);
+    } else {
+        color_t light = shade(color, 1.5f);
+        color_t dark  = shade(color, 0.5f);
+        if (shown == ei_relief_sunken) {
+            color_t tmp = light;
+            light = dark;
+            dark = tmp;
+        }
+
+        // The border masks are anti-aliased, and only change color from frame to frame: they
+        // are cached. The top half is drawn over the whole border, so that their edges blend
+        // together without a seam.
+        MaskCache& masks = MaskCache::getInstance();
+        masks.rounded_frame(location.size, corner_radius, BT_FULL)
+             .draw(surface, location.top_left, dark, &clip);
+        masks.rounded_frame(location.size, corner_radius, BT_TOP)
+             .draw(surface, location.top_left, light, &clip);
+        fill_rounded_rect(surface, inner, corner_radius - border_width, color, &clip);
+        if (pick_buffer != NULL)
+            fill_rounded_rect(*pick_buffer, location, corner_radius, pick_id, &clip);
+    }
+
+    draw_content(surface, inner, clip);
+
+    Widget::draw(surface, pick_buffer, clipper);
+}
+
+bool_t Button::contains(const Point& where) const
+{
+    return rounded_rect_contains(screen_location(), corner_radius, where);
+}
+
+bool_t Button::opaque(Rect* area) const
+{
+    if (corner_radius > 0)
+        return EI_FALSE;
+    return Frame::opaque(area);
+}
+
+void Button::configure(Size*            requested_size,
+                       const color_t*   color,
+                       int*             border_width,
+                       int*             corner_radius,
+                       relief_t*        relief,
+                       const char **    text,
+                       font_t*          text_font,
+                       color_t*         text_color,
+                       anchor_t*        text_anchor,
+                       surface_t*       img,
+                       Rect**           img_rect,
+                       anchor_t*        img_anchor)
+{
+    // The caller keeps the ownership of the font and of the image.
+    Font font = text_font != NULL ? Font::borrow(*text_font) : Font();
+    Surface image = img != NULL ? Surface::borrow(*img) : Surface();
+    configure_shared(requested_size, color, border_width, corner_radius, relief, text,
+                     text_font != NULL ? &font : NULL, text_color, text_anchor,
+                     img != NULL ? &image : NULL, img_rect, img_anchor);
+}
+
+void Button::configure_shared(Size*            requested_size,
+                              const color_t*   color,
+                              int*             border_width,
+                              int*             corner_radius,
+                              relief_t*        relief,
+                              const char **    text,
+                              const Font*      text_font,
+                              color_t*         text_color,
+                              anchor_t*        text_anchor,
+                              const Surface*   img,
+                              Rect**           img_rect,
+                              anchor_t*        img_anchor)
+{
+    // The corners shape the picked area.
+    int dirty = ei_dirty_none;
+    if (corner_radius != NULL && *corner_radius != this->corner_radius) {
+        this->corner_radius = *corner_radius;
+        dirty |= ei_dirty_pick;
+    }
+    configure_frame(requested_size, color, border_width, relief, text, text_font, text_color,
+                    text_anchor, img, img_rect, img_anchor, dirty);
+}
+
+bool_t Button::on_buttondown(Widget* widget, Event* event, void* user_param)
+{
+    Button* button = static_cast<Button*>(user_param);
+    button->pressed = EI_TRUE;
+    button->invalidate(ei_dirty_paint);
+    // The callbacks of the programmer are called too.
+    return EI_FALSE;
+}
+
+bool_t Button::on_buttonup(Widget* widget, Event* event, void* user_param)
+{
+    Button* button = static_cast<Button*>(user_param);
+    if (button->pressed == EI_TRUE) {
+        button->pressed = EI_FALSE;
+        button->invalidate(ei_dirty_paint);
+    }
+    return EI_FALSE;
+}
+
+static const int k_toplevel_corner_radius = 8;    ///< Radius of the top corners of the title bar.
+static const int k_toplevel_handle_size   = 12;   ///< Side of the resize handle.
+static const color_t k_toplevel_close_color = {0xd0, 0x30, 0x30, 0xff};
+
+/**
+ * \brief   The title bar is as high as its text, plus some margin.
+ */
+static int title_bar_height(const std::string& title)
+{
+    if (ei_default_font == NULL)
+        return 0;
+    Size size;
+    hw_text_compute_size(title.empty() ? "Tg" : title.c_str(), ei_default_font, size);
+    return (int)size.height + 8;
+}
+
+Toplevel::Toplevel(Widget* parent)
+    : Widget("toplevel", parent), color(ei_default_background_color), border_width(4),
+      title("Toplevel"), closable(EI_TRUE), resizable(ei_axis_both), min_size(160, 120),
+      title_height(0), action(ei_action_none)
+{
+    title_height = title_bar_height(title);
+    requested_size = Size(320, 240) + Size(2 * border_width, title_height + border_width);
+
+    EventManager::getInstance().bind(ei_ev_mouse_buttondown, this, "", on_buttondown, this);
+    EventManager::getInstance().bind(ei_ev_mouse_buttonup, NULL, "all", on_buttonup, this);
+    EventManager::getInstance().bind(ei_ev_mouse_move, NULL, "all", on_mousemove, this);
+}
+
+Toplevel::~Toplevel()
+{
+    EventManager::getInstance().unbind(ei_ev_mouse_buttondown, this, "", on_buttondown, this);
+    EventManager::getInstance().unbind(ei_ev_mouse_buttonup, NULL, "all", on_buttonup, this);
+    EventManager::getInstance().unbind(ei_ev_mouse_move, NULL, "all", on_mousemove, this);
+}
+
+void Toplevel::draw(surface_t surface, IdBuffer* pick_buffer, Rect* clipper)
+{
+    const Rect location = screen_location();
+    Rect clip = location;
+    if (clipper != NULL && !rect_intersection(*clipper, location, &clip))
+        return;
+
+    const Point& top_left = location.top_left;
+    int width = location.size.width, height = location.size.height;
+    color_t dark = shade(color, 0.5f);
+
+    // Title bar, only its top corners are rounded: the bottom ones are clipped out.
+    Rect title_bar(top_left, Size(width, title_height));
+    Rect title_clip;
+    if (rect_intersection(title_bar, clip, &title_clip)) {
+        Rect rounded(top_left, Size(width, title_height + 2 * k_toplevel_corner_radius));
+        fill_rounded_rect(surface, rounded, k_toplevel_corner_radius, dark, &title_clip);
+        if (pick_buffer != NULL)
+            fill_rounded_rect(*pick_buffer, rounded, k_toplevel_corner_radius, pick_id, &title_clip);
+        if (closable == EI_TRUE)
+            fill_circle(surface, close_center(), close_radius(), k_toplevel_close_color, &title_clip);
+
+        Size size;
+        hw_text_compute_size(title.c_str(), ei_default_font, size);
+        Point where = top_left + Point(title_height, (title_height - (int)size.height) / 2);
+        Rect visible;
+        if (rect_intersection(Rect(where, size), title_clip, &visible))
+            draw_text(surface, &where, title.c_str(), ei_default_font, &ei_font_default_color);
+    }
+
+    // Border and content.
+    Rect body(top_left + Point(0, title_height), Size(width, height - title_height));
+    fill_rounded_rect(surface, pick_buffer, body, 0, dark, pick_id, &clip);
+    fill_rounded_rect(surface, content_rect(), 0, color, &clip);
+    if (resizable != ei_axis_none)
+        fill_rounded_rect(surface, resize_handle(), 0, dark, &clip);
+
+    Widget::draw(surface, pick_buffer, clipper);
+}
+
+void Toplevel::geomnotify(Rect rect)
+{
+    screen_location() = rect;
+    content_rect() = Rect(rect.top_left + Point(border_width, title_height),
+                          rect.size - Size(2 * border_width, title_height + border_width));
+}
+
+bool_t Toplevel::contains(const Point& where) const
+{
+    // Only the top corners of the title bar are rounded.
+    const Rect location = screen_location();
+    if (where.y >= location.top_left.y + title_height)
+        return rect_contains(location, where);
+    Rect rounded(location.top_left, Size(location.size.width, title_height + 2 * k_toplevel_corner_radius));
+    return rounded_rect_contains(rounded, k_toplevel_corner_radius, where);
+}
+
+bool_t Toplevel::opaque(Rect* area) const
+{
+    // Below the rounded corners of the title bar.
+    if (color.alpha != 0xff)
+        return EI_FALSE;
+    const Rect location = screen_location();
+    *area = Rect(location.top_left + Point(0, k_toplevel_corner_radius),
+                 location.size - Size(0, k_toplevel_corner_radius));
+    return EI_TRUE;
+}
+
+void Toplevel::configure(Size*           requested_size,
+                         color_t*        color,
+                         int*            border_width,
+                         const char**    title,
+                         bool_t*         closable,
+                         axis_set_t*     resizable,
+                         Size*           min_size)
+{
+    Size content_size = requested_size != NULL ? *requested_size
+                      : this->requested_size - Size(2 * this->border_width, title_height + this->border_width);
+
+    int dirty = ei_dirty_none;
+    if (color != NULL && color_equal(*color, this->color) == EI_FALSE) {
+        this->color = *color;
+        dirty |= ei_dirty_paint;
+    }
+    if (border_width != NULL && *border_width != this->border_width) {
+        this->border_width = *border_width;
+        dirty |= ei_dirty_layout;
+    }
+    if (title != NULL && this->title != (*title != NULL ? *title : "")) {
+        this->title = *title != NULL ? *title : "";
+        dirty |= ei_dirty_paint;
+    }
+    if (closable != NULL && *closable != this->closable) {
+        this->closable = *closable;
+        dirty |= ei_dirty_paint;
+    }
+    if (resizable != NULL && *resizable != this->resizable) {
+        this->resizable = *resizable;
+        dirty |= ei_dirty_paint;
+    }
+    if (min_size != NULL)
+        this->min_size = *min_size;
+
+    // The title bar shapes the picked area, the border and the title bar place the content.
+    int previous_height = title_height;
+    title_height = title_bar_height(this->title);
+    if (title_height != previous_height)
+        dirty |= ei_dirty_pick | ei_dirty_layout;
+    Size previous_size = this->requested_size;
+    this->requested_size = content_size + Size(2 * this->border_width, title_height + this->border_width);
+    if (this->requested_size.width != previous_size.width || this->requested_size.height != previous_size.height)
+        dirty |= ei_dirty_layout;
+
+    if ((dirty & ei_dirty_layout) != 0 && geom_manager() == NULL)
+        geomnotify(screen_location());
+    invalidate(dirty);
+}
+
+Point Toplevel::close_center() const
+{
+    return screen_location().top_left + Point(title_height / 2, title_height / 2);
+}
+
+int Toplevel::close_radius() const
+{
+    return title_height / 2 > 6 ? title_height / 2 - 5 : 1;
+}
+
+Rect Toplevel::resize_handle() const
+{
+    Point bottom_right = screen_location().top_left
+                       + Point(screen_location().size.width, screen_location().size.height);
+    return Rect(bottom_right - Point(k_toplevel_handle_size, k_toplevel_handle_size),
+                Size(k_toplevel_handle_size, k_toplevel_handle_size));
+}
+
+/**
+ * \brief   Tells if a point is inside a rectangle.
+ */
+static bool point_in_rect(const Point& point, const Rect& rect)
+{
+    return point.x >= rect.top_left.x && point.x < rect.top_left.x + (int)rect.size.width
+        && point.y >= rect.top_left.y && point.y < rect.top_left.y + (int)rect.size.height;
+}
+
+bool_t Toplevel::on_buttondown(Widget* widget, Event* event, void* user_param)
+{
+    Toplevel* toplevel = static_cast<Toplevel*>(user_param);
+    const Point& where = static_cast<MouseEvent*>(event)->where;
+    Point delta = where - toplevel->close_center();
+
+    if (toplevel->closable == EI_TRUE
+            && delta.x * delta.x + delta.y * delta.y <= toplevel->close_radius() * toplevel->close_radius())
+        toplevel->action = ei_action_close;
+    else if (where.y < toplevel->screen_location().top_left.y + toplevel->title_height)
+        toplevel->action = ei_action_move;
+    else if (toplevel->resizable != ei_axis_none && point_in_rect(where, toplevel->resize_handle()))
+        toplevel->action = ei_action_resize;
+    else
+        return EI_FALSE;
+
+    toplevel->grab = where;
+    return EI_TRUE;
+}
+
+bool_t Toplevel::on_mousemove(Widget* widget, Event* event, void* user_param)
+{
+    Toplevel* toplevel = static_cast<Toplevel*>(user_param);
+    if (toplevel->action != ei_action_move && toplevel->action != ei_action_resize)
+        return EI_FALSE;
+    if (toplevel->geom_manager() != &Placer::getInstance())
+        return EI_FALSE;
+
+    const Point& where = static_cast<MouseEvent*>(event)->where;
+    Point delta = where - toplevel->grab;
+    toplevel->grab = where;
+
+    if (toplevel->action == ei_action_move) {
+        int x = toplevel->placement().absolute_pos.x + delta.x;
+        int y = toplevel->placement().absolute_pos.y + delta.y;
+        Placer::getInstance().configure(toplevel, NULL, &x, &y, NULL, NULL, NULL, NULL, NULL, NULL);
+    } else {
+        // The absolute size is what remains once the relative size is removed.
+        const Size& master = toplevel->getParent()->getContent_rect()->size;
+        const Size& size = toplevel->screen_location().size;
+        int min_width  = toplevel->min_size.width  + 2 * toplevel->border_width;
+        int min_height = toplevel->min_size.height + toplevel->title_height + toplevel->border_width;
+        int width  = std::max((int)size.width  + delta.x, min_width)
+                   - (int)(toplevel->placement().relative_size.width  * master.width);
+        int height = std::max((int)size.height + delta.y, min_height)
+                   - (int)(toplevel->placement().relative_size.height * master.height);
+        bool resize_x = toplevel->resizable == ei_axis_x || toplevel->resizable == ei_axis_both;
+        bool resize_y = toplevel->resizable == ei_axis_y || toplevel->resizable == ei_axis_both;
+        Placer::getInstance().configure(toplevel, NULL, NULL, NULL,
+                                        resize_x ? &width : NULL, resize_y ? &height : NULL,
+                                        NULL, NULL, NULL, NULL);
+    }
+    return EI_TRUE;
+}
+
+bool_t Toplevel::on_buttonup(Widget* widget, Event* event, void* user_param)
+{
+    Toplevel* toplevel = static_cast<Toplevel*>(user_param);
+    action_t action = toplevel->action;
+    if (action == ei_action_none)
+        return EI_FALSE;
+    toplevel->action = ei_action_none;
+
+    if (action == ei_action_close) {
+        Point delta = static_cast<MouseEvent*>(event)->where - toplevel->close_center();
+        if (delta.x * delta.x + delta.y * delta.y <= toplevel->close_radius() * toplevel->close_radius())
+            delete toplevel;
+    }
+    return EI_TRUE;
+}
+
+}
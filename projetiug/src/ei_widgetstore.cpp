@@ -0,0 +1,180 @@
+#include "ei_widgetstore.h"
+
+namespace ei {
+
+const int WidgetStore::k_none;
+const int WidgetStore::k_pick_handle_bits;
+const uint32_t WidgetStore::k_pick_handle_mask;
+const uint32_t WidgetStore::k_pick_generation_mask;
+const uint32_t WidgetStore::k_no_pick_id;
+
+WidgetStore::WidgetStore()
+    : m_removed(0), m_ordered(EI_TRUE)
+{
+}
+
+WidgetStore::handle_t WidgetStore::insert(Widget* widget, handle_t parent, bool_t root)
+{
+    handle_t handle;
+    if (m_free_handles.empty()) {
+        handle = (handle_t)m_indices.size();
+        m_indices.push_back(k_none);
+        m_generations.push_back(0);
+        m_parent_handles.push_back(k_none);
+        m_first_children.push_back(k_none);
+        m_last_children.push_back(k_none);
+        m_next_siblings.push_back(k_none);
+        m_previous_siblings.push_back(k_none);
+    } else {
+        handle = m_free_handles.back();
+        m_free_handles.pop_back();
+    }
+
+    int position = size();
+    int parent_index = k_none;
+    m_parent_handles[handle] = k_none;
+    m_first_children[handle] = k_none;
+    m_last_children[handle] = k_none;
+    m_next_siblings[handle] = k_none;
+    m_previous_siblings[handle] = k_none;
+
+    if (root == EI_FALSE) {
+        parent_index = m_indices[parent];
+        m_parent_handles[handle] = parent;
+        m_previous_siblings[handle] = m_last_children[parent];
+        if (m_last_children[parent] != k_none)
+            m_next_siblings[m_last_children[parent]] = handle;
+        else
+            m_first_children[parent] = handle;
+        m_last_children[parent] = handle;
+
+        // Appending to the subtree at the end of the arrays keeps the order, the subtrees of
+        // the ancestors then end at the new entry too.
+        if (m_ordered == EI_TRUE && m_ends[parent_index] == position) {
+            for (int ancestor = parent_index; ancestor != k_none; ancestor = m_parents[ancestor])
+                m_ends[ancestor]++;
+        } else {
+            m_ordered = EI_FALSE;
+        }
+    }
+
+    placement_t placement;
+    placement.anchor = ei_anc_northwest;
+    placement.absolute_size = Size(-1.f, -1.f);
+
+    m_widgets.push_back(widget);
+    m_handles.push_back(handle);
+    m_parents.push_back(parent_index);
+    m_ends.push_back(position + 1);
+    m_screen_locations.push_back(Rect());
+    m_content_rects.push_back(Rect());
+    m_managers.push_back(NULL);
+    m_placements.push_back(placement);
+    m_indices[handle] = position;
+    return handle;
+}
+
+void WidgetStore::remove(handle_t handle)
+{
+    int parent = m_parent_handles[handle];
+    if (parent != k_none) {
+        int previous = m_previous_siblings[handle];
+        int next = m_next_siblings[handle];
+        if (previous != k_none)
+            m_next_siblings[previous] = next;
+        else
+            m_first_children[parent] = next;
+        if (next != k_none)
+            m_previous_siblings[next] = previous;
+        else
+            m_last_children[parent] = previous;
+    }
+
+    int index = m_indices[handle];
+    m_widgets[index] = NULL;
+    m_managers[index] = NULL;
+    m_indices[handle] = k_none;
+    m_generations[handle]++;
+    m_free_handles.push_back(handle);
+
+    // The removed entries stay in place, skipped by the scans, until they are the majority.
+    m_removed++;
+    if (m_removed == size()) {
+        m_removed = 0;
+        m_ordered = EI_TRUE;
+        m_widgets.clear();
+        m_handles.clear();
+        m_parents.clear();
+        m_ends.clear();
+        m_screen_locations.clear();
+        m_content_rects.clear();
+        m_managers.clear();
+        m_placements.clear();
+    } else if (m_removed > 64 && 2 * m_removed > size()) {
+        sort();
+    }
+}
+
+/**
+ * \brief   Moves the entries of a permutation of the indices in their new places.
+ */
+template <typename T>
+static void permute(std::vector<T>& entries, const std::vector<int>& old_indices)
+{
+    std::vector<T> sorted(old_indices.size());
+    for (size_t i = 0; i < old_indices.size(); i++)
+        sorted[i] = entries[old_indices[i]];
+    entries.swap(sorted);
+}
+
+void WidgetStore::sort()
+{
+    std::vector<int> old_indices;
+    std::vector<int> ends;
+    old_indices.reserve(size() - m_removed);
+    ends.reserve(size() - m_removed);
+
+    // Depth-first walk of every tree, the roots in the order of their entries.
+    for (int i = 0; i < size(); i++) {
+        if (m_widgets[i] == NULL || m_parents[i] != k_none)
+            continue;
+        int root = m_handles[i];
+        int handle = root;
+        for (;;) {
+            old_indices.push_back(m_indices[handle]);
+            ends.push_back(0);
+            m_indices[handle] = (int)old_indices.size() - 1;
+            if (m_first_children[handle] != k_none) {
+                handle = m_first_children[handle];
+                continue;
+            }
+            // Closes the subtrees ending here, up to an ancestor with a next sibling.
+            while (handle != root && m_next_siblings[handle] == k_none) {
+                ends[m_indices[handle]] = (int)old_indices.size();
+                handle = m_parent_handles[handle];
+            }
+            ends[m_indices[handle]] = (int)old_indices.size();
+            if (handle == root)
+                break;
+            handle = m_next_siblings[handle];
+        }
+    }
+
+    permute(m_widgets, old_indices);
+    permute(m_handles, old_indices);
+    permute(m_screen_locations, old_indices);
+    permute(m_content_rects, old_indices);
+    permute(m_managers, old_indices);
+    permute(m_placements, old_indices);
+    m_ends.swap(ends);
+    m_parents.resize(old_indices.size());
+    for (int i = 0; i < size(); i++) {
+        int parent = m_parent_handles[m_handles[i]];
+        m_parents[i] = parent != k_none ? m_indices[parent] : k_none;
+    }
+
+    m_removed = 0;
+    m_ordered = EI_TRUE;
+}
+
+}
@@ -0,0 +1,1169 @@
+#include "hw_headless.h"
+#include "ei_raster.h"
+#include "ei_event.h"
+#include "ei_main.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
+
+using namespace ei;
+
+const int EI_MOUSEBUTTON_LEFT   = 1;
+const int EI_MOUSEBUTTON_MIDDLE = 3;
+const int EI_MOUSEBUTTON_RIGHT  = 2;
+
+namespace ei {
+font_t ei_default_font = NULL;
+}
+
+/********** Surfaces. **********/
+
+/**
+ * @brief A surface of the in-memory backend. Like Allegro bitmaps, images and text are
+ *        stored with premultiplied alpha.
+ */
+typedef struct {
+    uint8_t*         data;      ///< The top-left pixel.
+    int              width;
+    int              height;
+    int              pitch;     ///< Number of bytes between two consecutive rows.
+    surface_format_t format;
+    int              locks;     ///< Number of pending \ref hw_surface_lock.
+    void*            owner;     ///< The surface owning the pixels of a view, NULL if it owns them.
+    int              x, y;      ///< Position of a view in its owner.
+} hw_surface_t;
+
+static hw_surface_t* s_window = NULL;
+static const int     k_screen_width  = 1920;    ///< Size of a full screen window.
+static const int     k_screen_height = 1080;
+
+static hw_surface_t* surface_alloc(int width, int height, surface_format_t format = ei_format_rgba8888)
+{
+    hw_surface_t* s = (hw_surface_t*) malloc(sizeof(hw_surface_t));
+    s->width  = width  > 0 ? width  : 0;
+    s->height = height > 0 ? height : 0;
+    s->format = format;
+    // Rows are padded to 4 bytes, like the bitmaps of Allegro.
+    s->pitch  = (s->width * bytes_per_pixel(format) + 3) & ~3;
+    s->locks  = 0;
+    s->data   = (uint8_t*) calloc((size_t)s->pitch * s->height + 4, 1);
+    s->owner  = NULL;
+    s->x = s->y = 0;
+    return s;
+}
+
+/**
+ * @brief The pixel (x, y) of a surface in the \ref ei_format_rgba8888 format.
+ */
+static inline color_t* rgba_pixel(hw_surface_t* s, int x, int y)
+{
+    return (color_t*) (s->data + y * s->pitch) + x;
+}
+
+surface_t hw_create_window(Size* size, const bool_t fullScreen)
+{
+    // Without a display, a full screen window takes the size of a common screen.
+    if (fullScreen == EI_TRUE)
+        *size = Size(k_screen_width, k_screen_height);
+
+    // Opening the window again gives it the new size, the surface stays the same.
+    int width = (int)size->width, height = (int)size->height;
+    if (s_window == NULL) {
+        s_window = surface_alloc(width, height);
+    } else if (s_window->width != width || s_window->height != height) {
+        hw_surface_t* resized = surface_alloc(width, height);
+        free(s_window->data);
+        *s_window = *resized;
+        free(resized);
+    }
+    color_t black = {0x00, 0x00, 0x00, 0xff};
+    for (int y = 0; y < s_window->height; y++)
+        for (int x = 0; x < s_window->width; x++)
+            *rgba_pixel(s_window, x, y) = black;
+
+    if (ei_default_font == NULL)
+        ei_default_font = hw_text_font_create(ei_default_font_filename, ei_font_default_size);
+
+    return s_window;
+}
+
+surface_t hw_surface_create(const surface_t root, const Size* size)
+{
+    return surface_alloc((int)size->width, (int)size->height);
+}
+
+surface_t hw_headless_surface_create(const Size* size, surface_format_t format)
+{
+    return surface_alloc((int)size->width, (int)size->height, format);
+}
+
+surface_t hw_headless_surface_create_view(const surface_t surface, const Rect* rect)
+{
+    hw_surface_t* parent = (hw_surface_t*) surface;
+    hw_surface_t* s = (hw_surface_t*) malloc(sizeof(hw_surface_t));
+    *s = *parent;
+    s->width  = (int)rect->size.width;
+    s->height = (int)rect->size.height;
+    s->data   = parent->data + rect->top_left.y * parent->pitch + rect->top_left.x * bytes_per_pixel(parent->format);
+    s->locks  = 0;
+    s->owner  = parent->owner != NULL ? parent->owner : parent;
+    s->x = parent->x + rect->top_left.x;
+    s->y = parent->y + rect->top_left.y;
+    return s;
+}
+
+surface_t hw_headless_get_owner(const surface_t surface, Point* origin)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    *origin = Point(s->x, s->y);
+    return s->owner != NULL ? s->owner : s;
+}
+
+void hw_surface_free(surface_t surface)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    if (s == NULL || s == s_window)
+        return;
+    if (s->owner == NULL)
+        free(s->data);
+    free(s);
+}
+
+void hw_surface_lock(surface_t surface)
+{
+    ((hw_surface_t*) surface)->locks++;
+}
+
+void hw_surface_unlock(surface_t surface)
+{
+    ((hw_surface_t*) surface)->locks--;
+}
+
+Size hw_surface_get_size(const surface_t surface)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    return Size(s->width, s->height);
+}
+
+void hw_surface_update_rects(const linked_rect_t* rects)
+{
+    // Nothing is displayed: the root surface already holds the final pixels.
+}
+
+Rect hw_surface_get_rect(const surface_t surface)
+{
+    return Rect(Point(0, 0), hw_surface_get_size(surface));
+}
+
+color_t hw_get_pixel(const surface_t surface, const Point pos)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    if (pos.x < 0 || pos.y < 0 || pos.x >= s->width || pos.y >= s->height) {
+        color_t none = {0, 0, 0, 0};
+        return none;
+    }
+    return load_pixel(s->format, s->data + pos.y * s->pitch + pos.x * bytes_per_pixel(s->format));
+}
+
+void hw_put_pixel(const surface_t surface, const Point pos, const color_t color)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    if (pos.x < 0 || pos.y < 0 || pos.x >= s->width || pos.y >= s->height)
+        return;
+    store_pixel(s->format, s->data + pos.y * s->pitch + pos.x * bytes_per_pixel(s->format), color);
+}
+
+void* hw_headless_get_data(const surface_t surface, int* pitch)
+{
+    hw_surface_t* s = (hw_surface_t*) surface;
+    *pitch = s->pitch;
+    return s->data;
+}
+
+surface_format_t hw_headless_get_format(const surface_t surface)
+{
+    return ((hw_surface_t*) surface)->format;
+}
+
+/********** Images. **********/
+
+static bool read_file(const char* filename, std::vector<uint8_t>& data)
+{
+    FILE* f = fopen(filename, "rb");
+    if (f == NULL)
+        return false;
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    data.resize(length > 0 ? length : 0);
+    bool ok = length > 0 && fread(&data[0], 1, length, f) == (size_t)length;
+    fclose(f);
+    return ok;
+}
+
+static inline uint32_t be32(const uint8_t* p) { return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]; }
+static inline uint16_t be16(const uint8_t* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+static inline int16_t  be16s(const uint8_t* p) { return (int16_t)be16(p); }
+static inline uint32_t le32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+static inline uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+
+/**
+ * @brief Minimal "inflate" (RFC 1951) decoder, enough for the zlib stream of PNG files.
+ */
+typedef struct {
+    short count[16];    ///< Number of codes of each length.
+    short symbol[288];  ///< Symbols ordered by code.
+} huffman_t;
+
+typedef struct {
+    const uint8_t* src;
+    size_t  length;
+    size_t  pos;
+    uint32_t bitbuf;
+    int     bitcnt;
+    bool    error;
+    std::vector<uint8_t>* out;
+} inflate_t;
+
+static int inflate_bits(inflate_t* s, int need)
+{
+    uint32_t val = s->bitbuf;
+    while (s->bitcnt < need) {
+        if (s->pos >= s->length) {
+            s->error = true;
+            return 0;
+        }
+        val |= (uint32_t)s->src[s->pos++] << s->bitcnt;
+        s->bitcnt += 8;
+    }
+    s->bitbuf = val >> need;
+    s->bitcnt -= need;
+    return (int)(val & ((1u << need) - 1));
+}
+
+static void huffman_build(huffman_t* h, const short* length, int n)
+{
+    short offs[16];
+    memset(h->count, 0, sizeof(h->count));
+    for (int symbol = 0; symbol < n; symbol++)
+        h->count[length[symbol]]++;
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++)
+        offs[len + 1] = offs[len] + h->count[len];
+    for (int symbol = 0; symbol < n; symbol++)
+        if (length[symbol] != 0)
+            h->symbol[offs[length[symbol]]++] = symbol;
+}
+
+static int huffman_decode(inflate_t* s, const huffman_t* h)
+{
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= inflate_bits(s, 1);
+        int count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    s->error = true;
+    return -1;
+}
+
+static bool inflate_codes(inflate_t* s, const huffman_t* lencode, const huffman_t* distcode)
+{
+    static const short lbase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static const short lext[29]  = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static const short dbase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                                    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                                    8193, 12289, 16385, 24577};
+    static const short dext[30]  = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    std::vector<uint8_t>& out = *s->out;
+
+    while (!s->error) {
+        int symbol = huffman_decode(s, lencode);
+        if (symbol < 0 || symbol > 285)
+            return false;
+        if (symbol < 256) {
+            out.push_back((uint8_t)symbol);
+        } else if (symbol == 256) {
+            return true;
+        } else {
+            symbol -= 257;
+            int len = lbase[symbol] + inflate_bits(s, lext[symbol]);
+            symbol = huffman_decode(s, distcode);
+            if (symbol < 0 || symbol > 29)
+                return false;
+            size_t dist = dbase[symbol] + inflate_bits(s, dext[symbol]);
+            if (dist > out.size())
+                return false;
+            for (; len > 0; len--)
+                out.push_back(out[out.size() - dist]);
+        }
+    }
+    return false;
+}
+
+static bool inflate(const uint8_t* src, size_t length, std::vector<uint8_t>& out)
+{
+    static const short order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    inflate_t s = {src, length, 0, 0, 0, false, &out};
+    huffman_t lencode, distcode;
+    short lengths[288 + 32];
+    int last;
+
+    do {
+        last = inflate_bits(&s, 1);
+        int type = inflate_bits(&s, 2);
+        if (type == 0) {
+            // Stored block
+            s.bitbuf = 0;
+            s.bitcnt = 0;
+            if (s.pos + 4 > s.length)
+                return false;
+            unsigned len = le16(s.src + s.pos);
+            s.pos += 4;
+            if (s.pos + len > s.length)
+                return false;
+            out.insert(out.end(), s.src + s.pos, s.src + s.pos + len);
+            s.pos += len;
+        } else if (type == 1) {
+            // Fixed Huffman codes
+            int symbol = 0;
+            for (; symbol < 144; symbol++) lengths[symbol] = 8;
+            for (; symbol < 256; symbol++) lengths[symbol] = 9;
+            for (; symbol < 280; symbol++) lengths[symbol] = 7;
+            for (; symbol < 288; symbol++) lengths[symbol] = 8;
+            huffman_build(&lencode, lengths, 288);
+            for (symbol = 0; symbol < 30; symbol++) lengths[symbol] = 5;
+            huffman_build(&distcode, lengths, 30);
+            if (!inflate_codes(&s, &lencode, &distcode))
+                return false;
+        } else if (type == 2) {
+            // Dynamic Huffman codes
+            int nlen  = inflate_bits(&s, 5) + 257;
+            int ndist = inflate_bits(&s, 5) + 1;
+            int ncode = inflate_bits(&s, 4) + 4;
+            int index;
+            for (index = 0; index < 19; index++)
+                lengths[order[index]] = index < ncode ? inflate_bits(&s, 3) : 0;
+            huffman_build(&lencode, lengths, 19);
+            for (index = 0; index < nlen + ndist && !s.error;) {
+                int symbol = huffman_decode(&s, &lencode), len = 0, repeat;
+                if (symbol < 0)
+                    return false;
+                if (symbol < 16) {
+                    lengths[index++] = symbol;
+                    continue;
+                }
+                if (symbol == 16) {
+                    if (index == 0)
+                        return false;
+                    len = lengths[index - 1];
+                    repeat = 3 + inflate_bits(&s, 2);
+                } else if (symbol == 17) {
+                    repeat = 3 + inflate_bits(&s, 3);
+                } else {
+                    repeat = 11 + inflate_bits(&s, 7);
+                }
+                if (index + repeat > nlen + ndist)
+                    return false;
+                while (repeat--)
+                    lengths[index++] = len;
+            }
+            huffman_build(&lencode, lengths, nlen);
+            huffman_build(&distcode, lengths + nlen, ndist);
+            if (!inflate_codes(&s, &lencode, &distcode))
+                return false;
+        } else {
+            return false;
+        }
+    } while (!last && !s.error);
+
+    return !s.error;
+}
+
+static inline uint8_t paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    if (pa <= pb && pa <= pc)
+        return a;
+    return pb <= pc ? b : c;
+}
+
+static hw_surface_t* png_decode(const std::vector<uint8_t>& data)
+{
+    static const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    if (data.size() < 8 || memcmp(&data[0], signature, 8) != 0)
+        return NULL;
+
+    int width = 0, height = 0, depth = 0, type = -1, interlace = 0;
+    std::vector<uint8_t> idat, palette, trns;
+    size_t pos = 8;
+    while (pos + 12 <= data.size()) {
+        uint32_t length = be32(&data[pos]);
+        const uint8_t* chunk = &data[pos + 8];
+        if (pos + 12 + length > data.size())
+            return NULL;
+        if (memcmp(&data[pos + 4], "IHDR", 4) == 0) {
+            width  = be32(chunk);
+            height = be32(chunk + 4);
+            depth  = chunk[8];
+            type   = chunk[9];
+            interlace = chunk[12];
+        } else if (memcmp(&data[pos + 4], "PLTE", 4) == 0) {
+            palette.assign(chunk, chunk + length);
+        } else if (memcmp(&data[pos + 4], "tRNS", 4) == 0) {
+            trns.assign(chunk, chunk + length);
+        } else if (memcmp(&data[pos + 4], "IDAT", 4) == 0) {
+            idat.insert(idat.end(), chunk, chunk + length);
+        } else if (memcmp(&data[pos + 4], "IEND", 4) == 0) {
+            break;
+        }
+        pos += 12 + length;
+    }
+
+    static const int channels_of[7] = {1, 0, 3, 1, 2, 0, 4};
+    if (width <= 0 || height <= 0 || type < 0 || type > 6 || channels_of[type] == 0 ||
+            interlace != 0 || (depth != 8 && !(type == 3 && depth < 8)) || idat.size() < 2) {
+        fprintf(stderr, "unsupported png format\n");
+        return NULL;
+    }
+
+    // Skip the 2 bytes zlib header, the adler checksum is not verified.
+    std::vector<uint8_t> raw;
+    if (!inflate(&idat[2], idat.size() - 2, raw))
+        return NULL;
+
+    int channels = channels_of[type];
+    size_t stride = ((size_t)width * channels * depth + 7) / 8;
+    int bpp = (channels * depth + 7) / 8;
+    if (raw.size() < (stride + 1) * height)
+        return NULL;
+
+    // Undo the per-row filters in place.
+    std::vector<uint8_t> prior(stride, 0);
+    for (int y = 0; y < height; y++) {
+        uint8_t filter = raw[y * (stride + 1)];
+        uint8_t* row = &raw[y * (stride + 1) + 1];
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= (size_t)bpp ? row[i - bpp] : 0;
+            int b = prior[i];
+            int c = i >= (size_t)bpp ? prior[i - bpp] : 0;
+            switch (filter) {
+            case 1: row[i] += a; break;
+            case 2: row[i] += b; break;
+            case 3: row[i] += (a + b) / 2; break;
+            case 4: row[i] += paeth(a, b, c); break;
+            default: break;
+            }
+        }
+        memcpy(&prior[0], row, stride);
+    }
+
+    // Convert to premultiplied RGBA, as al_load_bitmap does by default.
+    hw_surface_t* s = surface_alloc(width, height);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = &raw[y * (stride + 1) + 1];
+        for (int x = 0; x < width; x++) {
+            int r, g, b, a = 255;
+            if (type == 3) {
+                int bit = x * depth;
+                int index = (row[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1);
+                if ((size_t)(index * 3 + 2) >= palette.size())
+                    index = 0;
+                r = palette.size() > 2 ? palette[index * 3] : 0;
+                g = palette.size() > 2 ? palette[index * 3 + 1] : 0;
+                b = palette.size() > 2 ? palette[index * 3 + 2] : 0;
+                if ((size_t)index < trns.size())
+                    a = trns[index];
+            } else {
+                const uint8_t* p = row + x * channels;
+                r = p[0];
+                g = channels >= 3 ? p[1] : p[0];
+                b = channels >= 3 ? p[2] : p[0];
+                if (channels == 2 || channels == 4)
+                    a = p[channels - 1];
+            }
+            color_t* dst = rgba_pixel(s, x, y);
+            dst->red   = (uint8_t)((r * a + 127) / 255);
+            dst->green = (uint8_t)((g * a + 127) / 255);
+            dst->blue  = (uint8_t)((b * a + 127) / 255);
+            dst->alpha = (uint8_t)a;
+        }
+    }
+    return s;
+}
+
+static hw_surface_t* bmp_decode(const std::vector<uint8_t>& data)
+{
+    if (data.size() < 54 || data[0] != 'B' || data[1] != 'M')
+        return NULL;
+
+    uint32_t offset = le32(&data[10]);
+    int width  = (int)le32(&data[18]);
+    int height = (int)le32(&data[22]);
+    int bits   = le16(&data[28]);
+    int compression = (int)le32(&data[30]);
+    bool bottom_up = height > 0;
+    height = abs(height);
+    if (width <= 0 || (bits != 24 && bits != 32) || (compression != 0 && compression != 3)) {
+        fprintf(stderr, "unsupported bmp format\n");
+        return NULL;
+    }
+
+    size_t stride = ((size_t)width * bits / 8 + 3) & ~(size_t)3;
+    if (offset + stride * height > data.size())
+        return NULL;
+
+    hw_surface_t* s = surface_alloc(width, height);
+    for (int y = 0; y < height; y++) {
+        const uint8_t* row = &data[offset + stride * (bottom_up ? height - 1 - y : y)];
+        for (int x = 0; x < width; x++) {
+            const uint8_t* p = row + x * bits / 8;
+            color_t* dst = rgba_pixel(s, x, y);
+            dst->blue  = p[0];
+            dst->green = p[1];
+            dst->red   = p[2];
+            dst->alpha = 0xff;
+        }
+    }
+    return s;
+}
+
+surface_t hw_image_load(const char* filename)
+{
+    std::vector<uint8_t> data;
+    if (!read_file(filename, data)) {
+        fprintf(stderr, "cannot read image %s\n", filename);
+        return NULL;
+    }
+
+    hw_surface_t* s = png_decode(data);
+    if (s == NULL)
+        s = bmp_decode(data);
+    if (s == NULL)
+        fprintf(stderr, "cannot decode image %s\n", filename);
+    return s;
+}
+
+/********** Fonts. **********/
+
+/**
+ * @brief A TrueType font, with the offsets of the tables needed to lay out and rasterize
+ *        outlines. Hinting instructions are ignored.
+ */
+typedef struct {
+    std::vector<uint8_t> data;
+    uint32_t cmap, glyf, loca, hmtx;
+    int      loca_long;
+    int      num_glyphs;
+    int      num_hmetrics;
+    float    scale;     ///< Pixels per font unit.
+    float    ascent;    ///< In pixels.
+    float    descent;   ///< In pixels, negative.
+} hw_font_t;
+
+static uint32_t font_find_table(const std::vector<uint8_t>& data, const char* tag)
+{
+    int num_tables = be16(&data[4]);
+    for (int i = 0; i < num_tables; i++) {
+        const uint8_t* record = &data[12 + 16 * i];
+        if ((size_t)(12 + 16 * i + 16) <= data.size() && memcmp(record, tag, 4) == 0)
+            return be32(record + 8);
+    }
+    return 0;
+}
+
+font_t hw_text_font_create(const char* filename, int size)
+{
+    hw_font_t* font = new hw_font_t;
+    if (!read_file(filename, font->data) || font->data.size() < 12) {
+        fprintf(stderr, "cannot load font %s\n", filename);
+        delete font;
+        return NULL;
+    }
+
+    const std::vector<uint8_t>& d = font->data;
+    uint32_t head = font_find_table(d, "head");
+    uint32_t hhea = font_find_table(d, "hhea");
+    uint32_t maxp = font_find_table(d, "maxp");
+    font->cmap = font_find_table(d, "cmap");
+    font->glyf = font_find_table(d, "glyf");
+    font->loca = font_find_table(d, "loca");
+    font->hmtx = font_find_table(d, "hmtx");
+    if (!head || !hhea || !maxp || !font->cmap || !font->glyf || !font->loca || !font->hmtx) {
+        fprintf(stderr, "unsupported font %s\n", filename);
+        delete font;
+        return NULL;
+    }
+
+    font->scale        = (float)size / be16(&d[head + 18]);
+    font->loca_long    = be16s(&d[head + 50]);
+    font->num_glyphs   = be16(&d[maxp + 4]);
+    font->ascent       = be16s(&d[hhea + 4]) * font->scale;
+    font->descent      = be16s(&d[hhea + 6]) * font->scale;
+    font->num_hmetrics = be16(&d[hhea + 34]);
+
+    // Keep only the offset of the unicode BMP subtable (format 4).
+    uint32_t cmap = font->cmap;
+    font->cmap = 0;
+    for (int i = 0; i < be16(&d[cmap + 2]); i++) {
+        const uint8_t* record = &d[cmap + 4 + 8 * i];
+        int platform = be16(record), encoding = be16(record + 2);
+        uint32_t subtable = cmap + be32(record + 4);
+        if ((platform == 0 || (platform == 3 && encoding == 1)) && be16(&d[subtable]) == 4) {
+            font->cmap = subtable;
+            break;
+        }
+    }
+    if (font->cmap == 0) {
+        fprintf(stderr, "no unicode mapping in font %s\n", filename);
+        delete font;
+        return NULL;
+    }
+    return font;
+}
+
+void hw_text_font_free(font_t font)
+{
+    delete (hw_font_t*) font;
+}
+
+static int font_glyph_index(const hw_font_t* font, uint32_t codepoint)
+{
+    if (codepoint > 0xffff)
+        return 0;
+    const uint8_t* table = &font->data[font->cmap];
+    int segments = be16(table + 6) / 2;
+    const uint8_t* end_codes   = table + 14;
+    const uint8_t* start_codes = end_codes + 2 * segments + 2;
+    const uint8_t* deltas      = start_codes + 2 * segments;
+    const uint8_t* range_offs  = deltas + 2 * segments;
+
+    for (int i = 0; i < segments; i++) {
+        if (be16(end_codes + 2 * i) < codepoint)
+            continue;
+        uint16_t start = be16(start_codes + 2 * i);
+        if (start > codepoint)
+            return 0;
+        uint16_t delta = be16(deltas + 2 * i);
+        uint16_t range = be16(range_offs + 2 * i);
+        if (range == 0)
+            return (uint16_t)(codepoint + delta);
+        uint16_t glyph = be16(range_offs + 2 * i + range + 2 * (codepoint - start));
+        return glyph == 0 ? 0 : (uint16_t)(glyph + delta);
+    }
+    return 0;
+}
+
+static float font_advance(const hw_font_t* font, int glyph)
+{
+    int metric = glyph < font->num_hmetrics ? glyph : font->num_hmetrics - 1;
+    return be16(&font->data[font->hmtx + 4 * metric]) * font->scale;
+}
+
+/**
+ * @brief Decodes the next code point of an UTF-8 string and advances the pointer.
+ */
+static uint32_t utf8_next(const char** text)
+{
+    const uint8_t* s = (const uint8_t*) *text;
+    uint32_t c = *s++;
+    int extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if (extra)
+        c &= 0x3f >> extra;
+    while (extra-- > 0 && (*s & 0xc0) == 0x80)
+        c = (c << 6) | (*s++ & 0x3f);
+    *text = (const char*) s;
+    return c;
+}
+
+void hw_text_compute_size(const char* text, const font_t font, Size& size)
+{
+    const hw_font_t* f = (const hw_font_t*) font;
+    float width = 0.f;
+    while (f != NULL && *text != '\0')
+        width += font_advance(f, font_glyph_index(f, utf8_next(&text)));
+    size = f == NULL ? Size() : Size(ceilf(width), ceilf(f->ascent - f->descent));
+}
+
+/**
+ * @brief Coverage accumulation buffer: every outline segment adds its signed area to the
+ *        pixels it crosses, the running sum along a row is then the pixel coverage.
+ */
+typedef struct {
+    std::vector<float> cells;
+    int width;      ///< Width of the text, the buffer has two more columns.
+    int height;
+} coverage_t;
+
+static void coverage_line(coverage_t* c, float x0, float y0, float x1, float y1)
+{
+    if (y0 == y1)
+        return;
+    float dir = 1.f;
+    if (y0 > y1) {
+        float t;
+        t = x0; x0 = x1; x1 = t;
+        t = y0; y0 = y1; y1 = t;
+        dir = -1.f;
+    }
+    float dxdy = (x1 - x0) / (y1 - y0);
+    float x = x0;
+    if (y0 < 0.f) {
+        x -= y0 * dxdy;
+        y0 = 0.f;
+    }
+    if (y1 > c->height)
+        y1 = (float)c->height;
+
+    int stride = c->width + 2;
+    for (int y = (int)y0; y < c->height && y < y1; y++) {
+        float* row = &c->cells[y * stride];
+        float dy = fminf(y + 1.f, y1) - fmaxf((float)y, y0);
+        float xnext = x + dxdy * dy;
+        float d = dy * dir;
+        float xa = fminf(fmaxf(fminf(x, xnext), 0.f), (float)c->width);
+        float xb = fminf(fmaxf(fmaxf(x, xnext), 0.f), (float)c->width);
+        int xa_i = (int)floorf(xa);
+        int xb_i = (int)ceilf(xb);
+        if (xb_i <= xa_i + 1) {
+            float xm = 0.5f * (xa + xb) - xa_i;
+            row[xa_i]     += d - d * xm;
+            row[xa_i + 1] += d * xm;
+        } else {
+            float s = 1.f / (xb - xa);
+            float xa_f = xa - xa_i;
+            float a0 = 0.5f * s * (1.f - xa_f) * (1.f - xa_f);
+            float xb_f = xb - xb_i + 1.f;
+            float am = 0.5f * s * xb_f * xb_f;
+            row[xa_i] += d * a0;
+            if (xb_i == xa_i + 2) {
+                row[xa_i + 1] += d * (1.f - a0 - am);
+            } else {
+                float a1 = s * (1.5f - xa_f);
+                row[xa_i + 1] += d * (a1 - a0);
+                for (int xi = xa_i + 2; xi < xb_i - 1; xi++)
+                    row[xi] += d * s;
+                float a2 = a1 + (xb_i - xa_i - 3) * s;
+                row[xb_i - 1] += d * (1.f - a2 - am);
+            }
+            row[xb_i] += d * am;
+        }
+        x = xnext;
+    }
+}
+
+typedef struct {
+    float x, y;
+    bool on;
+} outline_point_t;
+
+static void coverage_quad(coverage_t* c, float x0, float y0, float x1, float y1, float x2, float y2)
+{
+    float devx = x0 - 2.f * x1 + x2;
+    float devy = y0 - 2.f * y1 + y2;
+    int n = 1 + (int)floorf(sqrtf(sqrtf(3.f * (devx * devx + devy * devy))));
+    float px = x0, py = y0;
+    for (int i = 1; i <= n; i++) {
+        float t = (float)i / n, u = 1.f - t;
+        float qx = u * u * x0 + 2.f * u * t * x1 + t * t * x2;
+        float qy = u * u * y0 + 2.f * u * t * y1 + t * t * y2;
+        coverage_line(c, px, py, qx, qy);
+        px = qx;
+        py = qy;
+    }
+}
+
+static void coverage_contour(coverage_t* c, const outline_point_t* pts, int n)
+{
+    if (n < 2)
+        return;
+
+    // Start on an on-curve point, or on the implicit one between two off-curve points.
+    int first = 0;
+    while (first < n && !pts[first].on)
+        first++;
+    outline_point_t start, control = pts[0];
+    bool has_control = false;
+    int count = n;
+    if (first == n) {
+        start.x = 0.5f * (pts[0].x + pts[n - 1].x);
+        start.y = 0.5f * (pts[0].y + pts[n - 1].y);
+        start.on = true;
+        has_control = true;
+        first = 0;
+        count = n - 1;
+    } else {
+        start = pts[first];
+    }
+
+    outline_point_t current = start;
+    for (int i = 1; i <= count; i++) {
+        const outline_point_t& p = pts[(first + i) % n];
+        if (p.on) {
+            if (has_control)
+                coverage_quad(c, current.x, current.y, control.x, control.y, p.x, p.y);
+            else
+                coverage_line(c, current.x, current.y, p.x, p.y);
+            current = p;
+            has_control = false;
+        } else {
+            if (has_control) {
+                outline_point_t mid = {0.5f * (control.x + p.x), 0.5f * (control.y + p.y), true};
+                coverage_quad(c, current.x, current.y, control.x, control.y, mid.x, mid.y);
+                current = mid;
+            }
+            control = p;
+            has_control = true;
+        }
+    }
+    if (has_control)
+        coverage_quad(c, current.x, current.y, control.x, control.y, start.x, start.y);
+    else
+        coverage_line(c, current.x, current.y, start.x, start.y);
+}
+
+/**
+ * @brief Accumulates the outline of a glyph. The transform maps font units to pixels:
+ *        x' = m[0] x + m[2] y + m[4], y' = m[1] x + m[3] y + m[5].
+ */
+static void coverage_glyph(coverage_t* c, const hw_font_t* font, int glyph, const float m[6], int depth)
+{
+    if (glyph < 0 || glyph >= font->num_glyphs || depth > 8)
+        return;
+
+    const std::vector<uint8_t>& d = font->data;
+    uint32_t start, end;
+    if (font->loca_long) {
+        start = be32(&d[font->loca + 4 * glyph]);
+        end   = be32(&d[font->loca + 4 * glyph + 4]);
+    } else {
+        start = 2 * be16(&d[font->loca + 2 * glyph]);
+        end   = 2 * be16(&d[font->loca + 2 * glyph + 2]);
+    }
+    if (end <= start)
+        return;
+
+    const uint8_t* g = &d[font->glyf + start];
+    int contours = be16s(g);
+
+    if (contours < 0) {
+        // Composite glyph: accumulate every component with its own offset and scale.
+        const uint8_t* p = g + 10;
+        uint16_t flags;
+        do {
+            flags = be16(p);
+            int component = be16(p + 2);
+            p += 4;
+            float dx, dy;
+            if (flags & 0x0001) {
+                dx = be16s(p);
+                dy = be16s(p + 2);
+                p += 4;
+            } else {
+                dx = (int8_t)p[0];
+                dy = (int8_t)p[1];
+                p += 2;
+            }
+            float a = 1.f, b = 0.f, cc = 0.f, dd = 1.f;
+            if (flags & 0x0008) {
+                a = dd = be16s(p) / 16384.f;
+                p += 2;
+            } else if (flags & 0x0040) {
+                a  = be16s(p) / 16384.f;
+                dd = be16s(p + 2) / 16384.f;
+                p += 4;
+            } else if (flags & 0x0080) {
+                a  = be16s(p) / 16384.f;
+                b  = be16s(p + 2) / 16384.f;
+                cc = be16s(p + 4) / 16384.f;
+                dd = be16s(p + 6) / 16384.f;
+                p += 8;
+            }
+            if (!(flags & 0x0002))
+                dx = dy = 0.f;   // point matching is not supported
+            float sub[6] = {
+                m[0] * a + m[2] * b,  m[1] * a + m[3] * b,
+                m[0] * cc + m[2] * dd, m[1] * cc + m[3] * dd,
+                m[0] * dx + m[2] * dy + m[4], m[1] * dx + m[3] * dy + m[5]
+            };
+            coverage_glyph(c, font, component, sub, depth + 1);
+        } while (flags & 0x0020);
+        return;
+    }
+
+    const uint8_t* end_points = g + 10;
+    int num_points = contours > 0 ? be16(end_points + 2 * (contours - 1)) + 1 : 0;
+    const uint8_t* p = end_points + 2 * contours;
+    p += 2 + be16(p);   // skip the hinting instructions
+
+    std::vector<uint8_t> flags(num_points);
+    for (int i = 0; i < num_points;) {
+        uint8_t flag = *p++;
+        flags[i++] = flag;
+        if (flag & 0x08)
+            for (int repeat = *p++; repeat > 0 && i < num_points; repeat--)
+                flags[i++] = flag;
+    }
+
+    std::vector<outline_point_t> pts(num_points);
+    int value = 0;
+    for (int i = 0; i < num_points; i++) {
+        if (flags[i] & 0x02) {
+            value += (flags[i] & 0x10) ? *p : -*p;
+            p++;
+        } else if (!(flags[i] & 0x10)) {
+            value += be16s(p);
+            p += 2;
+        }
+        pts[i].x = (float)value;
+        pts[i].on = (flags[i] & 0x01) != 0;
+    }
+    value = 0;
+    for (int i = 0; i < num_points; i++) {
+        if (flags[i] & 0x04) {
+            value += (flags[i] & 0x20) ? *p : -*p;
+            p++;
+        } else if (!(flags[i] & 0x20)) {
+            value += be16s(p);
+            p += 2;
+        }
+        pts[i].y = (float)value;
+    }
+    for (int i = 0; i < num_points; i++) {
+        float x = pts[i].x, y = pts[i].y;
+        pts[i].x = m[0] * x + m[2] * y + m[4];
+        pts[i].y = m[1] * x + m[3] * y + m[5];
+    }
+
+    int begin = 0;
+    for (int i = 0; i < contours; i++) {
+        int last = be16(end_points + 2 * i);
+        if (last >= num_points || last < begin)
+            break;
+        coverage_contour(c, &pts[begin], last - begin + 1);
+        begin = last + 1;
+    }
+}
+
+surface_t hw_text_create_surface(const char* text, const font_t font, const color_t* color)
+{
+    const hw_font_t* f = (const hw_font_t*) font;
+    Size size;
+    hw_text_compute_size(text, font, size);
+    hw_surface_t* s = surface_alloc((int)size.width, (int)size.height);
+    if (f == NULL || s->width == 0 || s->height == 0)
+        return s;
+
+    coverage_t cov;
+    cov.width  = s->width;
+    cov.height = s->height;
+    cov.cells.assign((size_t)(cov.width + 2) * cov.height, 0.f);
+
+    float pen = 0.f;
+    while (*text != '\0') {
+        int glyph = font_glyph_index(f, utf8_next(&text));
+        float m[6] = {f->scale, 0.f, 0.f, -f->scale, pen, f->ascent};
+        coverage_glyph(&cov, f, glyph, m, 0);
+        pen += font_advance(f, glyph);
+    }
+
+    // Premultiplied alpha, like the bitmaps rendered by al_draw_text.
+    for (int y = 0; y < s->height; y++) {
+        const float* row = &cov.cells[y * (cov.width + 2)];
+        float acc = 0.f;
+        for (int x = 0; x < s->width; x++) {
+            acc += row[x];
+            float a = fminf(fabsf(acc), 1.f);
+            color_t* dst = rgba_pixel(s, x, y);
+            dst->red   = (uint8_t)(color->red   * a + 0.5f);
+            dst->green = (uint8_t)(color->green * a + 0.5f);
+            dst->blue  = (uint8_t)(color->blue  * a + 0.5f);
+            dst->alpha = (uint8_t)(255.f * a + 0.5f);
+        }
+    }
+    return s;
+}
+
+/********** Events. **********/
+
+static std::deque<Event*> s_events;
+static int s_exhausted = 0;
+static std::chrono::steady_clock::time_point s_start;
+
+void hw_headless_push_event(Event* event)
+{
+    s_events.push_back(event);
+}
+
+static Event* parse_event(const char* line)
+{
+    char type[32];
+    int a = 0, b = 0, c = 0;
+    int n = sscanf(line, "%31s %d %d %d", type, &a, &b, &c);
+    if (n < 1)
+        return NULL;
+
+    if (strcmp(type, "keydown") == 0 || strcmp(type, "keyup") == 0 || strcmp(type, "keychar") == 0) {
+        if (n < 2)
+            return NULL;
+        KeyEvent* e = new KeyEvent();
+        e->type = type[3] == 'd' ? ei_ev_keydown : type[3] == 'u' ? ei_ev_keyup : ei_ev_keychar;
+        e->key_sym = e->type == ei_ev_keychar ? 0 : a;
+        e->unichar = e->type == ei_ev_keychar ? a : 0;
+        e->modifier_mask = n >= 3 && e->type != ei_ev_keychar ? (ei_modifier_mask_t)b : 0;
+        return e;
+    }
+    if (strcmp(type, "mousedown") == 0 || strcmp(type, "mouseup") == 0 || strcmp(type, "mousemove") == 0) {
+        bool move = type[5] == 'm';
+        if (n < (move ? 3 : 4))
+            return NULL;
+        MouseEvent* e = new MouseEvent();
+        e->type = move ? ei_ev_mouse_move : type[5] == 'd' ? ei_ev_mouse_buttondown : ei_ev_mouse_buttonup;
+        e->where = Point(a, b);
+        e->button_number = move ? 0 : c;
+        return e;
+    }
+    if (strcmp(type, "display") == 0) {
+        char what[32];
+        if (sscanf(line, "%*s %31s", what) != 1)
+            return NULL;
+        DisplayEvent* e = new DisplayEvent();
+        e->type = ei_ev_display;
+        e->resized      = strcmp(what, "resized") == 0 ? EI_TRUE : EI_FALSE;
+        e->closed       = strcmp(what, "closed") == 0 ? EI_TRUE : EI_FALSE;
+        e->switched_out = strcmp(what, "switched_out") == 0 ? EI_TRUE : EI_FALSE;
+        e->switched_in  = strcmp(what, "switched_in") == 0 ? EI_TRUE : EI_FALSE;
+        return e;
+    }
+    if (strcmp(type, "app") == 0) {
+        AppEvent* e = new AppEvent();
+        e->type = ei_ev_app;
+        e->user_param = NULL;
+        return e;
+    }
+    return NULL;
+}
+
+bool_t hw_headless_load_script(const char* filename)
+{
+    FILE* f = fopen(filename, "r");
+    if (f == NULL) {
+        fprintf(stderr, "cannot read event script %s\n", filename);
+        return EI_FALSE;
+    }
+
+    char line[256];
+    int number = 0;
+    bool_t ok = EI_TRUE;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        number++;
+        char* comment = strchr(line, '#');
+        if (comment != NULL)
+            *comment = '\0';
+        char first[2];
+        if (sscanf(line, "%1s", first) != 1)
+            continue;
+        Event* event = parse_event(line);
+        if (event == NULL) {
+            fprintf(stderr, "%s:%d: invalid event\n", filename, number);
+            ok = EI_FALSE;
+            continue;
+        }
+        hw_headless_push_event(event);
+    }
+    fclose(f);
+    return ok;
+}
+
+Event* hw_event_wait_next()
+{
+    if (!s_events.empty()) {
+        Event* event = s_events.front();
+        s_events.pop_front();
+        return event;
+    }
+
+    if (s_exhausted++ == 0) {
+        KeyEvent* e = new KeyEvent();
+        e->type = ei_ev_keydown;
+        e->key_sym = ALLEGRO_KEY_ESCAPE;
+        e->unichar = 0;
+        e->modifier_mask = 0;
+        return e;
+    }
+    DisplayEvent* e = new DisplayEvent();
+    e->type = ei_ev_display;
+    e->resized = EI_FALSE;
+    e->closed = EI_TRUE;
+    e->switched_out = EI_FALSE;
+    e->switched_in = EI_FALSE;
+    return e;
+}
+
+bool_t hw_event_post_app(void* user_param)
+{
+    AppEvent* e = new AppEvent();
+    e->type = ei_ev_app;
+    e->user_param = user_param;
+    hw_headless_push_event(e);
+    return EI_TRUE;
+}
+
+/********** System. **********/
+
+void hw_init()
+{
+    s_start = std::chrono::steady_clock::now();
+    s_exhausted = 0;
+
+    const char* script = getenv("EI_HEADLESS_SCRIPT");
+    if (script != NULL && *script != '\0')
+        hw_headless_load_script(script);
+}
+
+void hw_quit()
+{
+    while (!s_events.empty()) {
+        delete s_events.front();
+        s_events.pop_front();
+    }
+    if (ei_default_font != NULL) {
+        hw_text_font_free(ei_default_font);
+        ei_default_font = NULL;
+    }
+    if (s_window != NULL) {
+        free(s_window->data);
+        free(s_window);
+        s_window = NULL;
+    }
+}
+
+void hw_wait(int s_delay)
+{
+    std::this_thread::sleep_for(std::chrono::seconds(s_delay));
+}
+
+double hw_now()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - s_start).count();
+}
+
+int main(int argc, char* argv[])
+{
+    return ei_main(argc, argv);
+}
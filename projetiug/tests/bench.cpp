@@ -0,0 +1,538 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ei_main.h"
+#include "ei_draw.h"
+#include "ei_widget.h"
+#include "ei_geometrymanager.h"
+#include "ei_occlusion.h"
+#include "ei_configurebatch.h"
+#include "hw_interface.h"
+
+using namespace ei;
+
+/*
+ * Micro-benchmarks of the drawing primitives.
+ *
+ * Every benchmark prints one CSV line:
+ *   label,benchmark,params,calls,ns_per_call,mpixels_per_s,allocs_per_call
+ * "label" is given with --label (e.g. the commit id), so that the output of several
+ * runs can be concatenated and compared. allocs_per_call is -1 when allocations cannot
+ * be counted on this platform.
+ *
+ * Options:
+ *   --label text      Value of the first column (defaults to "-").
+ *   --filter text     Only runs the benchmarks whose name or parameters contain text.
+ *   --min-time s      Minimal measured time per benchmark, in seconds (defaults to 0.2).
+ */
+
+static unsigned long s_allocations = 0;
+
+#if defined(__GLIBC__)
+/* Every allocation, including the ones of operator new, goes through malloc. */
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+
+extern "C" void* malloc(size_t size) noexcept
+{
+    s_allocations++;
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t count, size_t size) noexcept
+{
+    s_allocations++;
+    return __libc_calloc(count, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) noexcept
+{
+    s_allocations++;
+    return __libc_realloc(ptr, size);
+}
+
+static const bool s_count_allocations = true;
+#else
+static const bool s_count_allocations = false;
+#endif
+
+static const char* s_label = "-";
+static const char* s_filter = NULL;
+static double s_min_time = 0.2;
+
+static const color_t k_opaque = {0x20, 0x60, 0xa0, 0xff};
+static const color_t k_translucent = {0x20, 0x60, 0xa0, 0x80};
+static const color_t k_premultiplied = {0x10, 0x30, 0x50, 0x80};
+static const color_t k_clear = {0x00, 0x00, 0x00, 0x00};
+
+/*
+ * bench_t --
+ *
+ *  One parameterized benchmark: "run" draws once on "surface".
+ */
+struct bench_t {
+    std::string name;
+    std::string params;
+    surface_t   surface;
+    std::function<void()> run;
+};
+
+/*
+ * count_pixels --
+ *
+ *  Number of pixels of the surface changed by one call of the benchmark.
+ */
+static long count_pixels(const bench_t& bench)
+{
+    Size size = hw_surface_get_size(bench.surface);
+    fill(bench.surface, &k_clear, EI_TRUE);
+    bench.run();
+
+    long count = 0;
+    hw_surface_lock(bench.surface);
+    for (int y = 0; y < (int)size.height; y++) {
+        for (int x = 0; x < (int)size.width; x++) {
+            color_t c = hw_get_pixel(bench.surface, Point(x, y));
+            if (c.red != 0 || c.green != 0 || c.blue != 0 || c.alpha != 0)
+                count++;
+        }
+    }
+    hw_surface_unlock(bench.surface);
+    return count;
+}
+
+static void measure(const bench_t& bench)
+{
+    std::string id = bench.name + "," + bench.params;
+    if (s_filter != NULL && id.find(s_filter) == std::string::npos)
+        return;
+
+    long pixels = count_pixels(bench);
+
+    // Warm up, then double the number of calls until the minimal time is reached.
+    bench.run();
+    long calls = 1;
+    double elapsed = 0.;
+    unsigned long allocations = 0;
+    while (true) {
+        unsigned long first_allocation = s_allocations;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (long i = 0; i < calls; i++)
+            bench.run();
+        elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        allocations = s_allocations - first_allocation;
+        if (elapsed >= s_min_time)
+            break;
+        calls *= 2;
+    }
+
+    printf("%s,%s,%s,%ld,%.1f,%.3f,%.2f\n", s_label, bench.name.c_str(), bench.params.c_str(),
+           calls, elapsed * 1e9 / calls, pixels * calls / elapsed * 1e-6,
+           s_count_allocations ? (double)allocations / calls : -1.);
+    fflush(stdout);
+}
+
+/*
+ * make_polygon --
+ *
+ *  Regular polygon of "n" vertices inscribed in a circle, as a linked list of points.
+ */
+static void make_polygon(std::vector<linked_point_t>& points, const Point& center, int radius, int n)
+{
+    points.resize(n);
+    for (int i = 0; i < n; i++) {
+        points[i].point = Point(center.x + (int)lround(radius * cos(2. * M_PI * i / n)),
+                                center.y + (int)lround(radius * sin(2. * M_PI * i / n)));
+        points[i].next = i + 1 < n ? &points[i + 1] : NULL;
+    }
+}
+
+static std::string format(const char* fmt, int a, int b = 0, int c = 0, int d = 0)
+{
+    char buffer[128];
+    snprintf(buffer, sizeof(buffer), fmt, a, b, c, d);
+    return buffer;
+}
+
+int ei_main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--label") == 0 && i + 1 < argc) {
+            s_label = argv[++i];
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            s_filter = argv[++i];
+        } else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc) {
+            s_min_time = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "usage: %s [--label text] [--filter text] [--min-time seconds]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    Size window_size(1024, 1024);
+    hw_init();
+    surface_t window = hw_create_window(&window_size, EI_FALSE);
+
+    printf("label,benchmark,params,calls,ns_per_call,mpixels_per_s,allocs_per_call\n");
+
+    const int sizes[] = {16, 64, 256};
+    const int vertices[] = {4, 16, 64, 256};
+    std::vector<linked_point_t> points;
+
+    // fill
+    for (int size : sizes) {
+        Size surface_size(4 * size, 4 * size);
+        surface_t surface = hw_surface_create(window, &surface_size);
+        measure({"fill", format("size=%d", 4 * size), surface, [=]() {
+            fill(surface, &k_opaque, EI_FALSE);
+        }});
+        hw_surface_free(surface);
+    }
+
+    // Offscreen formats: translucent spans, and conversion to the window
+    const char* format_names[] = {"rgba8888", "rgbx8888", "a8"};
+    for (int f = ei_format_rgba8888; f <= ei_format_a8; f++) {
+        Size surface_size(256, 256);
+        surface_t surface = create_surface(window, &surface_size, (surface_format_t)f);
+        const Rect rect(Point(0, 0), surface_size);
+        measure({"fill_rounded_rect", std::string("format=") + format_names[f], surface, [=]() {
+            fill_rounded_rect(surface, rect, 0, k_translucent, NULL);
+        }});
+        const Point where(100, 100);
+        measure({"ei_copy_surface", std::string("size=256;use_alpha=1;format=") + format_names[f], window, [=]() {
+            ei_copy_surface(window, surface, &where, EI_TRUE);
+        }});
+        hw_surface_free(surface);
+    }
+
+    // Picking: the ids written in an offscreen as colors, or in an id buffer
+    {
+        Size surface_size(256, 256);
+        surface_t surface = create_surface(window, &surface_size, ei_format_rgbx8888);
+        const Rect rect(Point(0, 0), surface_size);
+        const color_t id_color = {0x12, 0x34, 0x05, 0xff};
+        measure({"pick_fill", "target=rgbx8888", surface, [=]() {
+            fill_rounded_rect(surface, rect, 8, id_color, NULL);
+        }});
+        for (int half = 0; half <= 1; half++) {
+            IdBuffer* ids = new IdBuffer();
+            ids->resize(surface_size, half == 1 ? EI_TRUE : EI_FALSE);
+            measure({"pick_fill", half == 1 ? "target=ids_half" : "target=ids", surface, [=]() {
+                fill_rounded_rect(*ids, rect, 8, 0x053412, NULL);
+            }});
+            delete ids;
+        }
+        hw_surface_free(surface);
+    }
+
+    // draw_polygon: size, vertex count, opaque or translucent, clipped or not
+    for (int radius : sizes) {
+        for (int n : vertices) {
+            for (int alpha = 0; alpha < 2; alpha++) {
+                for (int clipped = 0; clipped < 2; clipped++) {
+                    make_polygon(points, Point(512, 512), radius, n);
+                    const color_t color = alpha ? k_translucent : k_opaque;
+                    const Rect clipper(Point(512 - radius, 512 - radius), Size(radius, 2 * radius));
+                    const linked_point_t* first = &points[0];
+                    measure({"draw_polygon",
+                             format("radius=%d;vertices=%d;alpha=%d;clipped=%d", radius, n, color.alpha, clipped),
+                             window, [=]() {
+                        draw_polygon(window, first, color, clipped ? &clipper : NULL);
+                    }});
+                }
+            }
+        }
+    }
+
+    // Anti-aliased draw_polygon, to compare with the aliased one
+    for (int radius : sizes) {
+        for (int n : vertices) {
+            for (int alpha = 0; alpha < 2; alpha++) {
+                make_polygon(points, Point(512, 512), radius, n);
+                const color_t color = alpha ? k_translucent : k_opaque;
+                const linked_point_t* first = &points[0];
+                measure({"draw_polygon_antialiased",
+                         format("radius=%d;vertices=%d;alpha=%d;clipped=0", radius, n, color.alpha),
+                         window, [=]() {
+                    draw_polygon(window, first, color, NULL, EI_TRUE);
+                }});
+            }
+        }
+    }
+
+    // Grid of small icons: one draw_polygon per icon, or all of them in one draw_polygons
+    for (int count : {64, 1024, 4096}) {
+        int columns = (int)sqrt((double)count), cell = 1024 / columns;
+        std::shared_ptr<std::vector<linked_point_t>> grid(new std::vector<linked_point_t>(4 * count));
+        std::shared_ptr<std::vector<polygon_t>> batch(new std::vector<polygon_t>(count));
+        for (int i = 0; i < count; i++) {
+            make_polygon(points, Point((i % columns) * cell + cell / 2, (i / columns) * cell + cell / 2),
+                         cell / 3, 4);
+            for (int k = 0; k < 4; k++) {
+                (*grid)[4 * i + k].point = points[k].point;
+                (*grid)[4 * i + k].next = k < 3 ? &(*grid)[4 * i + k + 1] : NULL;
+            }
+            (*batch)[i].first_point = &(*grid)[4 * i];
+            (*batch)[i].color = i & 1 ? k_translucent : k_opaque;
+        }
+        measure({"draw_polygon*n", format("polygons=%d;size=%d", count, cell), window, [=]() {
+            for (const polygon_t& polygon : *batch)
+                draw_polygon(window, polygon.first_point, polygon.color, NULL);
+        }});
+        measure({"draw_polygons", format("polygons=%d;size=%d", count, cell), window, [=]() {
+            draw_polygons(window, &(*batch)[0], count, NULL);
+        }});
+    }
+
+    // Path: edge table built once, drawn at a new translation on every call
+    for (int radius : sizes) {
+        for (int n : vertices) {
+            make_polygon(points, Point(0, 0), radius, n);
+            Path path(&points[0]);
+            int step = 0;
+            measure({"Path::draw", format("radius=%d;vertices=%d;alpha=%d;clipped=0", radius, n, k_opaque.alpha),
+                     window, [=]() mutable {
+                path.draw(window, Point(512 + (step & 1), 512), k_opaque, NULL);
+                step++;
+            }});
+        }
+    }
+
+    // Rounded frames: rasterized on every call, or drawn from their cached coverage mask
+    for (int size : sizes) {
+        Rect frame(Point(512 - size, 512 - size / 2), Size(2 * size, size));
+        measure({"rounded_frame+draw_polygon", format("size=%dx%d", 2 * size, size), window, [=]() {
+            Rect rect = frame;
+            linked_point_t* points = rounded_frame(&rect, size / 4, BT_FULL);
+            draw_polygon(window, points, k_translucent, NULL);
+            while (points != NULL) {
+                linked_point_t* next = points->next;
+                free(points);
+                points = next;
+            }
+        }});
+        measure({"fill_rounded_rect", format("size=%dx%d", 2 * size, size), window, [=]() {
+            fill_rounded_rect(window, frame, size / 4, k_translucent, NULL);
+        }});
+        const Mask& mask = MaskCache::getInstance().rounded_frame(frame.size, size / 4, BT_FULL);
+        measure({"Mask::draw", format("size=%dx%d", 2 * size, size), window, [=, &mask]() {
+            mask.draw(window, frame.top_left, k_translucent, NULL);
+        }});
+    }
+    MaskCache::getInstance().clear();
+
+    // fill_circle
+    for (int radius : sizes) {
+        measure({"fill_circle", format("radius=%d", radius), window, [=]() {
+            fill_circle(window, Point(512, 512), radius, k_translucent, NULL);
+        }});
+    }
+
+    // draw_polyline
+    for (int radius : sizes) {
+        for (int n : vertices) {
+            for (int clipped = 0; clipped < 2; clipped++) {
+                make_polygon(points, Point(512, 512), radius, n);
+                const Rect clipper(Point(512 - radius, 512 - radius), Size(radius, 2 * radius));
+                const linked_point_t* first = &points[0];
+                measure({"draw_polyline",
+                         format("radius=%d;vertices=%d;alpha=%d;clipped=%d", radius, n, k_opaque.alpha, clipped),
+                         window, [=]() {
+                    draw_polyline(window, first, k_opaque, clipped ? &clipper : NULL);
+                }});
+            }
+        }
+    }
+
+    // Plots of many samples across the window, drawn segment by segment or decimated
+    for (int count : {10000, 1000000}) {
+        std::shared_ptr<std::vector<linked_point_t>> samples(new std::vector<linked_point_t>(count));
+        for (int i = 0; i < count; i++) {
+            (*samples)[i].point = Point((int)((long)i * 1024 / count),
+                                        512 + (int)lround(400 * sin(i * 0.001) + 50 * sin(i * 0.7)));
+            (*samples)[i].next = i + 1 < count ? &(*samples)[i + 1] : NULL;
+        }
+        for (int decimated = 0; decimated < 2; decimated++) {
+            measure({"draw_polyline_plot", format("samples=%d;decimated=%d", count, decimated), window, [=]() {
+                draw_polyline(window, &(*samples)[0], k_opaque, NULL, decimated ? EI_TRUE : EI_FALSE);
+            }});
+        }
+    }
+
+    // draw_text
+    const int lengths[] = {1, 8, 64};
+    for (int length : lengths) {
+        std::string text;
+        for (int i = 0; i < length; i++)
+            text += (char)('a' + i % 26);
+        const Point where(8, 512);
+        measure({"draw_text", format("length=%d", length), window, [=]() {
+            draw_text(window, &where, text.c_str(), NULL, &k_opaque);
+        }});
+    }
+
+    // ei_copy_surface: blit size, blended or not
+    for (int size : sizes) {
+        for (int use_alpha = 0; use_alpha < 2; use_alpha++) {
+            Size source_size(2 * size, 2 * size);
+            surface_t source = hw_surface_create(window, &source_size);
+            fill(source, &k_premultiplied, EI_TRUE);
+            const Point where(100, 100);
+            measure({"ei_copy_surface", format("size=%d;use_alpha=%d", 2 * size, use_alpha), window, [=]() {
+                ei_copy_surface(window, source, &where, use_alpha ? EI_TRUE : EI_FALSE);
+            }});
+            hw_surface_free(source);
+        }
+    }
+
+    // Traversals of a tree of widgets: 1000 containers of 100 frames, placed relatively
+    {
+        Size dummy_size(1, 1);
+        surface_t dummy = hw_surface_create(window, &dummy_size);
+        Frame* root = new Frame(NULL);
+        root->geomnotify(Rect(Point(0, 0), window_size));
+        Frame* top = new Frame(root);
+        float one = 1.f;
+        Placer::getInstance().configure(top, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &one, &one);
+        Widget* last = NULL;
+        for (int i = 0; i < 1000; i++) {
+            Frame* container = new Frame(top);
+            float rel_x = (i % 32) / 32.f, rel_y = (i / 32) / 32.f, rel_size = 1.f / 32.f;
+            Placer::getInstance().configure(container, NULL, NULL, NULL, NULL, NULL,
+                                            &rel_x, &rel_y, &rel_size, &rel_size);
+            for (int j = 0; j < 100; j++) {
+                Frame* frame = new Frame(container);
+                float x = (j % 10) / 10.f, y = (j / 10) / 10.f, size = 0.1f;
+                Placer::getInstance().configure(frame, NULL, NULL, NULL, NULL, NULL, &x, &y, &size, &size);
+                last = frame;
+            }
+        }
+        uint32_t last_id = last->getPick_id();
+        measure({"widget_tree_relayout", "widgets=100000", dummy, [=]() {
+            Placer::getInstance().run(top);
+        }});
+        measure({"widget_tree_pick", "widgets=100000", dummy, [=]() {
+            root->pick(last_id);
+        }});
+        measure({"widget_tree_hit", "widgets=100000", dummy, [=]() {
+            root->pick(Point(window_size.width - 2, window_size.height - 2));
+        }});
+        Rect corner(Point(window_size.width - 32, window_size.height - 32), Size(32, 32));
+        measure({"widget_tree_draw", "widgets=100000;clip=32x32", window, [=]() {
+            Rect clipper = corner;
+            root->draw(window, NULL, &clipper);
+        }});
+        delete root;
+        hw_surface_free(dummy);
+    }
+
+    // Drawing of widgets in color, with or without their pick ids
+    {
+        Frame* root = new Frame(NULL);
+        root->geomnotify(Rect(Point(0, 0), window_size));
+        relief_t relief = ei_relief_raised;
+        int border_width = 2;
+        for (int i = 0; i < 64; i++) {
+            Frame* frame = new Frame(root);
+            int x = (i % 8) * 128, y = (i / 8) * 128, size = 120;
+            frame->configure(NULL, NULL, &border_width, &relief, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+            Placer::getInstance().configure(frame, NULL, &x, &y, &size, &size, NULL, NULL, NULL, NULL);
+        }
+        IdBuffer* ids = new IdBuffer();
+        ids->resize(window_size, EI_FALSE);
+        measure({"widget_draw", "frames=64;pick=0", window, [=]() {
+            root->draw(window, NULL, NULL);
+        }});
+        measure({"widget_draw", "frames=64;pick=1", window, [=]() {
+            root->draw(window, ids, NULL);
+        }});
+        delete ids;
+        delete root;
+    }
+
+    // Drawing of stacked toplevels of 16 frames, with or without occlusion culling
+    {
+        Frame* root = new Frame(NULL);
+        Rect screen(Point(0, 0), window_size);
+        root->geomnotify(screen);
+        for (int i = 0; i < 8; i++) {
+            Toplevel* toplevel = new Toplevel(root);
+            int x = 100 + 8 * i, y = 100 + 8 * i, width = 600, height = 400;
+            Placer::getInstance().configure(toplevel, NULL, &x, &y, &width, &height, NULL, NULL, NULL, NULL);
+            for (int j = 0; j < 16; j++) {
+                Frame* frame = new Frame(toplevel);
+                float rel_x = (j % 4) / 4.f, rel_y = (j / 4) / 4.f, rel_size = 0.25f;
+                Placer::getInstance().configure(frame, NULL, NULL, NULL, NULL, NULL, &rel_x, &rel_y, &rel_size, &rel_size);
+            }
+        }
+        measure({"widget_draw_stacked", "toplevels=8;cull=0", window, [=]() {
+            root->draw(window, NULL, NULL);
+        }});
+        measure({"widget_draw_stacked", "toplevels=8;cull=1", window, [=]() {
+            Rect area = screen;
+            OcclusionCuller& culler = OcclusionCuller::getInstance();
+            culler.prepare(root, area);
+            if (culler.occluded(root) == ei_occluded_widget)
+                root->Widget::draw(window, NULL, &area);
+            else
+                root->draw(window, NULL, &area);
+            culler.finish();
+        }});
+        delete root;
+    }
+
+    // Configuration of a container and its 1000 frames, one by one or in a batch
+    {
+        Size dummy_size(1, 1);
+        surface_t dummy = hw_surface_create(window, &dummy_size);
+        Frame* root = new Frame(NULL);
+        root->geomnotify(Rect(Point(0, 0), window_size));
+        Frame* container = new Frame(root);
+        float one = 1.f;
+        Placer::getInstance().configure(container, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &one, &one);
+        std::vector<Frame*> frames;
+        for (int i = 0; i < 1000; i++) {
+            frames.push_back(new Frame(container));
+            int x = (i % 32) * 30, y = (i / 32) * 30;
+            Placer::getInstance().configure(frames[i], NULL, &x, &y, NULL, NULL, NULL, NULL, NULL, NULL);
+        }
+        for (int batch = 0; batch < 2; batch++) {
+            measure({"configure_batch", format("widgets=1000;batch=%d", batch), dummy, [=]() {
+                static int step = 0;
+                step++;
+                if (batch)
+                    ConfigureBatch::getInstance().begin();
+                int x = step % 8, width = 1000;
+                Placer::getInstance().configure(container, NULL, &x, &x, &width, &width, NULL, NULL, NULL, NULL);
+                for (int i = 0; i < 1000; i++) {
+                    color_t color = {(unsigned char)(step + i), 0x60, 0xa0, 0xff};
+                    Size size(20 + step % 4, 20);
+                    int fx = (i % 32) * 30, fy = (i / 32) * 30;
+                    frames[i]->configure(&size, &color, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+                    Placer::getInstance().configure(frames[i], NULL, &fx, &fy, NULL, NULL, NULL, NULL, NULL, NULL);
+                }
+                if (batch)
+                    ConfigureBatch::getInstance().commit();
+            }});
+        }
+        measure({"configure_color", "children=1000", dummy, [=]() {
+            static int step = 0;
+            color_t color = {(unsigned char)++step, 0x60, 0xa0, 0xff};
+            container->configure(NULL, &color, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+        }});
+        delete root;
+        hw_surface_free(dummy);
+    }
+
+    hw_quit();
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,21 @@
 #define CATCH_CONFIG_RUNNER
 #include "catch.hpp"
 
+#include <math.h>
+#include <stdlib.h>
+
 #include "ei_main.h"
 #include "ei_draw.h"
+#include "ei_widget.h"
+#include "ei_geometrymanager.h"
+#include "ei_eventmanager.h"
+#include "ei_renderstate.h"
+#include "ei_application.h"
+#include "ei_widget.h"
+#include "ei_geometrymanager.h"
+#include "ei_rendercache.h"
+#include "ei_occlusion.h"
+#include "ei_configurebatch.h"
 #include "hw_interface.h"
 
 using namespace ei;
@@ -19,6 +32,12 @@ TEST_CASE("create_window", "[unit]")
   REQUIRE( main_window_size.width  == query_size.width );
   REQUIRE( main_window_size.height == query_size.height );
 
+  // Opening the window again gives it the new size.
+  Size other_size(320, 200);
+  main_window = hw_create_window(&other_size, EI_FALSE);
+  query_size = hw_surface_get_size(main_window);
+  REQUIRE( query_size.width == 320 );
+  REQUIRE( query_size.height == 200 );
 }
 
 TEST_CASE("fill_window", "[unit]")
@@ -52,6 +71,970 @@ TEST_CASE("fill_window", "[unit]")
 
 }
 
+TEST_CASE("copy_surface", "[unit]")
+{
+  surface_t main_window = NULL, offscreen = NULL;
+  Size main_window_size(640,480), offscreen_size(10,10);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, green = {0x00, 0xff, 0x00, 0xff}, query_color;
+  Point where(20, 30);
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  offscreen = hw_surface_create(main_window, &offscreen_size);
+  fill(main_window, &red, EI_FALSE);
+  fill(offscreen, &green, EI_FALSE);
+
+  ei_copy_surface(main_window, offscreen, &where, EI_FALSE);
+  hw_surface_update_rects(NULL);
+
+  query_color = hw_get_pixel(main_window, Point(25, 35));
+  REQUIRE( query_color.red == green.red );
+  REQUIRE( query_color.green == green.green );
+  query_color = hw_get_pixel(main_window, Point(30, 35));
+  REQUIRE( query_color.red == red.red );
+  REQUIRE( query_color.green == red.green );
+
+  hw_surface_free(offscreen);
+}
+
+/**
+ * \brief   A frame that records where its geometry manager placed it.
+ */
+class PlacedFrame : public Frame
+{
+public:
+  PlacedFrame(Widget* parent) : Frame(parent) {}
+
+  virtual void geomnotify(Rect rect)
+  {
+    Frame::geomnotify(rect);
+    placed = rect;
+  }
+
+  Rect placed;
+};
+
+TEST_CASE("placer", "[unit]")
+{
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), Size(200, 160)));
+
+  // Absolute and relative coordinates add up, then the anchor is applied.
+  Placer& placer = Placer::getInstance();
+  anchor_t center = ei_anc_center;
+  int x = 0, y = 0, width = 40, height = 20;
+  float half = 0.5f, whole = 1.f;
+  PlacedFrame* child = new PlacedFrame(root);
+  placer.configure(child, &center, &x, &y, &width, &height, &half, &half, NULL, NULL);
+  REQUIRE( child->placed.top_left.x == 80 );
+  REQUIRE( child->placed.top_left.y == 70 );
+  REQUIRE( child->placed.size.width == 40 );
+  REQUIRE( child->placed.size.height == 20 );
+
+  // The children are placed in their parent, and move with it.
+  PlacedFrame* grandchild = new PlacedFrame(child);
+  placer.configure(grandchild, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &half, &whole);
+  REQUIRE( grandchild->placed.top_left.x == 80 );
+  REQUIRE( grandchild->placed.size.width == 20 );
+  REQUIRE( grandchild->placed.size.height == 20 );
+  x = 10;
+  placer.configure(child, NULL, &x, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( grandchild->placed.top_left.x == 90 );
+
+  // The descendants are destroyed with their parent.
+  uint32_t id = grandchild->getPick_id();
+  REQUIRE( root->pick(id) == grandchild );
+  delete child;
+  REQUIRE( root->pick(id) == NULL );
+
+  delete root;
+}
+
+static bool_t count_event(Widget* widget, Event* event, void* user_param)
+{
+  (*(int*)user_param)++;
+  return EI_FALSE;
+}
+
+static bool_t consume_event(Widget* widget, Event* event, void* user_param)
+{
+  (*(int*)user_param)++;
+  return EI_TRUE;
+}
+
+TEST_CASE("event_manager", "[unit]")
+{
+  EventManager& manager = EventManager::getInstance();
+  Frame* frame = new Frame(NULL);
+  int on_widget = 0, on_class = 0, on_all = 0, after = 0;
+  manager.bind(ei_ev_mouse_buttondown, frame, "", count_event, &on_widget);
+  manager.bind(ei_ev_mouse_buttondown, NULL, "frame", count_event, &on_class);
+  manager.bind(ei_ev_mouse_buttondown, NULL, "all", consume_event, &on_all);
+  manager.bind(ei_ev_mouse_buttondown, NULL, "all", count_event, &after);
+
+  // The callbacks are called in the order they were bound, until one consumes the event.
+  MouseEvent event;
+  event.type = ei_ev_mouse_buttondown;
+  REQUIRE( manager.handle(&event, frame) == EI_TRUE );
+  REQUIRE( on_widget == 1 );
+  REQUIRE( on_class == 1 );
+  REQUIRE( on_all == 1 );
+  REQUIRE( after == 0 );
+
+  // Without a widget, only the tag "all" is called.
+  manager.handle(&event, NULL);
+  REQUIRE( on_widget == 1 );
+  REQUIRE( on_all == 2 );
+
+  manager.unbind(ei_ev_mouse_buttondown, frame, "", count_event, &on_widget);
+  manager.unbind(ei_ev_mouse_buttondown, NULL, "frame", count_event, &on_class);
+  manager.unbind(ei_ev_mouse_buttondown, NULL, "all", consume_event, &on_all);
+  manager.unbind(ei_ev_mouse_buttondown, NULL, "all", count_event, &after);
+  REQUIRE( manager.handle(&event, frame) == EI_FALSE );
+  REQUIRE( after == 0 );
+
+  delete frame;
+}
+
+TEST_CASE("path", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, query_color;
+  linked_point_t points[4];
+  int coords[] = { 0, 0, 10, 0, 10, 10, 0, 10 };
+
+  for (int i = 0; i < 4; i++) {
+    points[i].point = Point(coords[i * 2], coords[i * 2 + 1]);
+    points[i].next = i < 3 ? &points[i + 1] : NULL;
+  }
+  Path path(points);
+  REQUIRE( path.bounding_box().size.width == 11 );
+  REQUIRE( path.bounding_box().size.height == 10 );
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+
+  // The same path drawn at two places, the first scanline included.
+  path.draw(main_window, Point(100, 50), blue, NULL);
+  path.draw(main_window, Point(200, 50), blue, NULL);
+  query_color = hw_get_pixel(main_window, Point(100, 50));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(210, 59));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(150, 55));
+  REQUIRE( query_color.red == red.red );
+
+  // Clipped drawing.
+  Rect clipper(Point(300, 50), Size(5, 5));
+  path.draw(main_window, Point(300, 50), blue, &clipper);
+  query_color = hw_get_pixel(main_window, Point(304, 54));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(305, 54));
+  REQUIRE( query_color.red == red.red );
+}
+
+TEST_CASE("antialiased_polygon", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, query_color;
+  linked_point_t points[3];
+  int coords[] = { 100, 100, 110, 100, 100, 110 };
+
+  for (int i = 0; i < 3; i++) {
+    points[i].point = Point(coords[i * 2], coords[i * 2 + 1]);
+    points[i].next = i < 2 ? &points[i + 1] : NULL;
+  }
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+
+  // The points are at the corners of the pixels: the diagonal cuts its pixels in halves.
+  draw_polygon(main_window, points, blue, NULL, EI_TRUE);
+  query_color = hw_get_pixel(main_window, Point(102, 102));
+  REQUIRE( query_color.blue == 0xff );
+  query_color = hw_get_pixel(main_window, Point(104, 105));
+  REQUIRE( query_color.blue == 0x80 );
+  REQUIRE( query_color.red == 0x7f );
+  query_color = hw_get_pixel(main_window, Point(105, 105));
+  REQUIRE( query_color.red == 0xff );
+
+  // Sub-pixel points, clipped on the left: the clipper does not change the coverage.
+  std::vector<float> bar = { 0.5f, 0.f, 3.25f, 0.f, 3.25f, 1.f, 0.5f, 1.f };
+  Path path;
+  path.set_points(bar);
+  REQUIRE( path.coverage_box().size.width == 4 );
+  Rect clipper(Point(201, 200), Size(10, 10));
+  path.draw(main_window, Point(200, 200), blue, &clipper, EI_TRUE);
+  query_color = hw_get_pixel(main_window, Point(200, 200));
+  REQUIRE( query_color.red == 0xff );
+  query_color = hw_get_pixel(main_window, Point(202, 200));
+  REQUIRE( query_color.blue == 0xff );
+  query_color = hw_get_pixel(main_window, Point(203, 200));
+  REQUIRE( query_color.blue == 0x40 );
+}
+
+TEST_CASE("draw_polygons", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff};
+  color_t green = {0x00, 0xff, 0x00, 0x80}, query_color;
+  linked_point_t points[3][4];
+  int coords[3][2] = { { 10, 10 }, { 15, 15 }, { 100, 10 } };
+
+  for (int p = 0; p < 3; p++) {
+    int x = coords[p][0], y = coords[p][1];
+    Point corners[4] = { Point(x, y), Point(x + 10, y), Point(x + 10, y + 10), Point(x, y + 10) };
+    for (int i = 0; i < 4; i++) {
+      points[p][i].point = corners[i];
+      points[p][i].next = i < 3 ? &points[p][i + 1] : NULL;
+    }
+  }
+  polygon_t polygons[3] = { { points[0], blue }, { points[1], green }, { points[2], blue } };
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+  draw_polygons(main_window, polygons, 3, NULL);
+
+  // The second square is blended over the first one where they overlap.
+  query_color = hw_get_pixel(main_window, Point(12, 12));
+  REQUIRE( query_color.blue == 0xff );
+  query_color = hw_get_pixel(main_window, Point(17, 17));
+  REQUIRE( query_color.green == 0x80 );
+  REQUIRE( query_color.blue == 0x7f );
+  query_color = hw_get_pixel(main_window, Point(22, 22));
+  REQUIRE( query_color.green == 0x80 );
+  REQUIRE( query_color.red == 0x7f );
+  query_color = hw_get_pixel(main_window, Point(105, 15));
+  REQUIRE( query_color.blue == 0xff );
+  query_color = hw_get_pixel(main_window, Point(50, 15));
+  REQUIRE( query_color.red == 0xff );
+}
+
+TEST_CASE("mask", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, query_color;
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+
+  // Cached masks are shared.
+  const Mask& mask = MaskCache::getInstance().rounded_frame(Size(40, 20), 5, BT_FULL);
+  REQUIRE( &mask == &MaskCache::getInstance().rounded_frame(Size(40, 20), 5, BT_FULL) );
+  REQUIRE( &mask == &MaskCache::getInstance().rounded_frame(Size(40, 20), 5.01f, BT_FULL) );
+  REQUIRE( &mask != &MaskCache::getInstance().rounded_frame(Size(40, 20), 5.5f, BT_FULL) );
+
+  mask.draw(main_window, Point(100, 100), blue, NULL);
+  query_color = hw_get_pixel(main_window, Point(120, 110));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(100, 100));
+  REQUIRE( query_color.red == red.red );
+
+  // The ring leaves the inside untouched.
+  const Mask& ring = MaskCache::getInstance().rounded_ring(Size(40, 20), 5, 2);
+  ring.draw(main_window, Point(200, 100), blue, NULL);
+  query_color = hw_get_pixel(main_window, Point(220, 100));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(220, 110));
+  REQUIRE( query_color.red == red.red );
+
+  MaskCache::getInstance().clear();
+}
+
+TEST_CASE("fill_rounded_rect", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, query_color;
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+
+  fill_rounded_rect(main_window, Rect(Point(100, 100), Size(40, 20)), 8, blue, NULL);
+  query_color = hw_get_pixel(main_window, Point(100, 100));
+  REQUIRE( query_color.red == red.red );
+  query_color = hw_get_pixel(main_window, Point(108, 100));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(100, 110));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(139, 119));
+  REQUIRE( query_color.red == red.red );
+  query_color = hw_get_pixel(main_window, Point(140, 110));
+  REQUIRE( query_color.red == red.red );
+
+  fill_circle(main_window, Point(200, 200), 10, blue, NULL);
+  query_color = hw_get_pixel(main_window, Point(210, 200));
+  REQUIRE( query_color.blue == blue.blue );
+  query_color = hw_get_pixel(main_window, Point(208, 208));
+  REQUIRE( query_color.red == red.red );
+}
+
+TEST_CASE("fill_rounded_rect_pair", "[unit]")
+{
+  // The single pass writes the same pixels as a color pass followed by an id pass.
+  Size size(96, 80);
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  surface_t single = create_surface(main_window, &size, ei_format_rgba8888);
+  surface_t twice = create_surface(main_window, &size, ei_format_rgba8888);
+  color_t black = {0x00, 0x00, 0x00, 0xff}, color = {0x20, 0x80, 0xc0, 0xff};
+  IdBuffer single_ids, twice_ids;
+
+  srand(44);
+  int mismatches = 0;
+  for (int n = 0; n < 200; n++) {
+    Rect rect(Point(rand() % 120 - 12, rand() % 100 - 10), Size(rand() % 60, rand() % 50));
+    Rect clipper(Point(rand() % 96 - 8, rand() % 80 - 8), Size(rand() % 90, rand() % 70));
+    int radius = rand() % 24;
+    // The buffer sometimes misses part of the shape, which takes the two-pass fallback.
+    Size buffer_size = n % 4 == 0 ? Size(48, 40) : size;
+
+    fill(single, &black, EI_FALSE);
+    fill(twice, &black, EI_FALSE);
+    single_ids.resize(buffer_size, EI_FALSE);
+    twice_ids.resize(buffer_size, EI_FALSE);
+    fill_rounded_rect(single, &single_ids, rect, radius, color, n, &clipper);
+    fill_rounded_rect(twice, rect, radius, color, &clipper);
+    fill_rounded_rect(twice_ids, rect, radius, n, &clipper);
+
+    for (int y = 0; y < size.height; y++) {
+      for (int x = 0; x < size.width; x++) {
+        color_t a = hw_get_pixel(single, Point(x, y)), b = hw_get_pixel(twice, Point(x, y));
+        if (a.red != b.red || a.green != b.green || a.blue != b.blue
+            || single_ids.at(Point(x, y)) != twice_ids.at(Point(x, y)))
+          mismatches++;
+      }
+    }
+  }
+  REQUIRE( mismatches == 0 );
+
+  hw_surface_free(single);
+  hw_surface_free(twice);
+}
+
+TEST_CASE("decimated_polyline", "[unit]")
+{
+  Size size(64, 64);
+  color_t black = {0x00, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff};
+  Rect clipper(Point(4, 0), Size(50, 64));
+  std::vector<linked_point_t> points(1000);
+
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  surface_t decimated = hw_surface_create(main_window, &size);
+  // Many samples per column, going back and forth.
+  for (int i = 0; i < (int)points.size(); i++) {
+    points[i].point = Point(i / 20, 32 + (int)lround(25 * sin(i * 0.37)));
+    points[i].next = i + 1 < (int)points.size() ? &points[i + 1] : NULL;
+  }
+
+  fill(main_window, &black, EI_FALSE);
+  fill(decimated, &black, EI_FALSE);
+  draw_polyline(main_window, &points[0], blue, &clipper);
+  draw_polyline(decimated, &points[0], blue, &clipper, EI_TRUE);
+  int differences = 0;
+  for (int y = 0; y < 64; y++)
+    for (int x = 0; x < 64; x++)
+      if (hw_get_pixel(main_window, Point(x, y)).blue != hw_get_pixel(decimated, Point(x, y)).blue)
+        differences++;
+  REQUIRE( differences == 0 );
+  REQUIRE( hw_get_pixel(decimated, Point(10, 7)).blue == 0xff );
+  hw_surface_free(decimated);
+}
+
+TEST_CASE("surface_view", "[unit]")
+{
+  Size size(64, 64);
+  color_t black = {0x00, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, red = {0xff, 0x00, 0x00, 0xff};
+  linked_point_t points[4];
+  int coords[] = { -100, -100, 100, -100, 100, 100, -100, 100 };
+
+  // An offscreen of known size: the window may have been opened with another size.
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  surface_t target = hw_surface_create(main_window, &size);
+  fill(target, &black, EI_FALSE);
+  Rect rect(Point(10, 20), Size(30, 100));
+  surface_t view = create_surface_view(target, &rect);
+  REQUIRE( hw_surface_get_size(view).width == 30 );
+  REQUIRE( hw_surface_get_size(view).height == 44 );
+
+  // The view has its own origin, and clips the primitives.
+  fill(view, &blue, EI_FALSE);
+  REQUIRE( hw_get_pixel(target, Point(9, 30)).blue == 0x00 );
+  REQUIRE( hw_get_pixel(target, Point(10, 20)).blue == 0xff );
+  REQUIRE( hw_get_pixel(target, Point(39, 63)).blue == 0xff );
+  REQUIRE( hw_get_pixel(target, Point(40, 30)).blue == 0x00 );
+  for (int i = 0; i < 4; i++) {
+    points[i].point = Point(coords[i * 2], coords[i * 2 + 1]);
+    points[i].next = i < 3 ? &points[i + 1] : NULL;
+  }
+  Rect inner(Point(5, 5), Size(10, 10));
+  surface_t nested = create_surface_view(view, &inner);
+  draw_polygon(nested, points, red, NULL);
+  REQUIRE( hw_get_pixel(view, Point(5, 5)).red == 0xff );
+  REQUIRE( hw_get_pixel(target, Point(15, 25)).red == 0xff );
+  REQUIRE( hw_get_pixel(target, Point(14, 25)).red == 0x00 );
+
+  // A blit queued on the parent is submitted before drawing on the view over it.
+  surface_t image = hw_surface_create(main_window, &size);
+  fill(image, &red, EI_FALSE);
+  BlitBatch& batch = BlitBatch::getInstance();
+  batch.begin();
+  Point where(0, 0);
+  ei_copy_surface(target, image, &where, EI_FALSE);
+  fill(view, &blue, EI_FALSE);
+  batch.end();
+  REQUIRE( hw_get_pixel(target, Point(20, 30)).blue == 0xff );
+  REQUIRE( hw_get_pixel(target, Point(5, 30)).red == 0xff );
+
+  hw_surface_free(nested);
+  hw_surface_free(view);
+  hw_surface_free(image);
+  hw_surface_free(target);
+}
+
+static int s_released = 0;
+
+static void count_release(void* resource)
+{
+  s_released++;
+}
+
+TEST_CASE("handle", "[unit]")
+{
+  int resource;
+  {
+    Handle<count_release> first(&resource);
+    Handle<count_release> second = first;
+    REQUIRE( first.use_count() == 2 );
+    Handle<count_release> moved(std::move(first));
+    REQUIRE( first.empty() == EI_TRUE );
+    REQUIRE( moved.get() == &resource );
+    REQUIRE( moved.use_count() == 2 );
+    second.reset();
+    REQUIRE( s_released == 0 );
+  }
+  REQUIRE( s_released == 1 );
+
+  {
+    Handle<count_release> borrowed = Handle<count_release>::borrow(&resource);
+    Handle<count_release> copy = borrowed;
+    REQUIRE( copy.use_count() == 0 );
+  }
+  REQUIRE( s_released == 1 );
+
+  // Widgets share an image without copying it.
+  Size size(16, 16);
+  Surface image(hw_surface_create(NULL, &size));
+  {
+    Frame first(NULL), second(NULL);
+    first.configure_shared(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &image, NULL, NULL);
+    second.configure_shared(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &image, NULL, NULL);
+    REQUIRE( image.use_count() == 3 );
+  }
+  REQUIRE( image.use_count() == 1 );
+
+  // Given as a raw surface, the image is only borrowed.
+  surface_t raw = image.get();
+  {
+    Frame frame(NULL);
+    frame.configure(NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &raw, NULL, NULL);
+    REQUIRE( image.use_count() == 1 );
+  }
+  REQUIRE( image.use_count() == 1 );
+}
+
+TEST_CASE("widget_store", "[unit]")
+{
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), Size(100, 100)));
+  float half = 0.5f, zero = 0.f;
+  Frame* left = new Frame(root);
+  Frame* right = new Frame(root);
+  Placer::getInstance().configure(left, NULL, NULL, NULL, NULL, NULL, &zero, &zero, &half, &half);
+  Placer::getInstance().configure(right, NULL, NULL, NULL, NULL, NULL, &half, &half, &half, &half);
+
+  // Children added breadth-first, out of the depth-first order.
+  Frame* children[2][3];
+  for (int j = 0; j < 3; j++) {
+    for (int i = 0; i < 2; i++) {
+      children[i][j] = new Frame(i == 0 ? left : right);
+      Placer::getInstance().configure(children[i][j], NULL, NULL, NULL, NULL, NULL, NULL, NULL, &half, &half);
+    }
+  }
+  Placer::getInstance().run(root);
+  REQUIRE( children[1][2]->getParent() == right );
+  REQUIRE( children[1][2]->getContent_rect()->top_left.x == 50 );
+  REQUIRE( children[1][2]->getContent_rect()->size.width == 25 );
+  REQUIRE( left->pick(children[0][1]->getPick_id()) == children[0][1] );
+  REQUIRE( left->pick(children[1][1]->getPick_id()) == NULL );
+  REQUIRE( root->pick(children[1][1]->getPick_id()) == children[1][1] );
+
+  // The ids of the destroyed widgets are recycled with another generation.
+  uint32_t stale_id = left->getPick_id();
+  delete left;
+  REQUIRE( children[1][0]->getParent() == right );
+  REQUIRE( root->pick(children[1][0]->getPick_id()) == children[1][0] );
+  Frame* recycled = new Frame(root);
+  REQUIRE( (recycled->getPick_id() & WidgetStore::k_pick_handle_mask) == (stale_id & WidgetStore::k_pick_handle_mask) );
+  REQUIRE( root->pick(stale_id) == NULL );
+  REQUIRE( root->pick(recycled->getPick_id()) == recycled );
+
+  // Nor after the 16th reuse of its handle.
+  for (int i = 1; i < 16; i++) {
+    delete recycled;
+    recycled = new Frame(root);
+  }
+  REQUIRE( (recycled->getPick_id() & WidgetStore::k_pick_handle_mask) == (stale_id & WidgetStore::k_pick_handle_mask) );
+  REQUIRE( root->pick(stale_id) == NULL );
+  delete root;
+}
+
+TEST_CASE("hit_grid", "[unit]")
+{
+  Size size(200, 160);
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  IdBuffer pick_buffer;
+  pick_buffer.resize(size, EI_FALSE);
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), size));
+
+  // Overlapping siblings, rounded corners, and a child clipped by its parent.
+  Placer& placer = Placer::getInstance();
+  int coords[][4] = { {10, 10, 120, 100}, {20, 20, 80, 60}, {100, 60, 80, 80}, {60, 50, 60, 60} };
+  Frame* frame = new Frame(root);
+  Button* inner = new Button(frame);
+  Button* over = new Button(root);
+  Button* clipped = new Button(frame);
+  Widget* widgets[] = { frame, inner, over, clipped };
+  for (int i = 0; i < 4; i++)
+    placer.configure(widgets[i], NULL, &coords[i][0], &coords[i][1], &coords[i][2], &coords[i][3],
+                     NULL, NULL, NULL, NULL);
+
+  root->draw(main_window, &pick_buffer, NULL);
+  int mismatches = 0;
+  for (int y = 0; y < size.height; y++)
+    for (int x = 0; x < size.width; x++)
+      if (root->pick(Point(x, y)) != root->pick(pick_buffer.at(Point(x, y))))
+        mismatches++;
+  REQUIRE( mismatches == 0 );
+
+  // The subtrees are skipped out of their bounds, which follow the moves.
+  int moved[] = {150, 10, 40, 40};
+  placer.configure(over, NULL, &moved[0], &moved[1], &moved[2], &moved[3], NULL, NULL, NULL, NULL);
+  Rect clipper(Point(150, 10), Size(40, 40));
+  root->draw(main_window, &pick_buffer, &clipper);
+  REQUIRE( pick_buffer.at(Point(170, 30)) == over->getPick_id() );
+  placer.configure(over, NULL, &coords[2][0], &coords[2][1], &coords[2][2], &coords[2][3], NULL, NULL, NULL, NULL);
+
+  // At half resolution, a pixel has the id of the top-left pixel of its block.
+  pick_buffer.resize(size, EI_TRUE);
+  root->draw(main_window, &pick_buffer, NULL);
+  REQUIRE( pick_buffer.at(Point(61, 61)) == inner->getPick_id() );
+  REQUIRE( pick_buffer.at(Point(11, 11)) == frame->getPick_id() );
+  REQUIRE( pick_buffer.at(Point(size.width, 0)) == IdBuffer::k_no_id );
+  REQUIRE( root->pick(Point(150, 100)) == over );
+  REQUIRE( frame->pick(Point(150, 100)) == NULL );
+
+  // Unmapped widgets and their descendants are not picked anymore.
+  placer.unmap(frame);
+  REQUIRE( root->pick(Point(50, 50)) == root );
+  delete root;
+}
+
+TEST_CASE("render_cache", "[unit]")
+{
+  Size size(200, 160);
+  color_t black = {0x00, 0x00, 0x00, 0xff}, red = {0xff, 0x00, 0x00, 0xff};
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  surface_t reference = hw_surface_create(main_window, &size);
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), size));
+
+  Placer& placer = Placer::getInstance();
+  relief_t relief = ei_relief_raised;
+  int border_width = 3, panel_coords[] = {10, 10, 120, 100}, button_coords[] = {20, 20, 60, 40};
+  Frame* panel = new Frame(root);
+  panel->configure(NULL, NULL, &border_width, &relief, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  placer.configure(panel, NULL, &panel_coords[0], &panel_coords[1], &panel_coords[2], &panel_coords[3], NULL, NULL, NULL, NULL);
+  Button* button = new Button(panel);
+  placer.configure(button, NULL, &button_coords[0], &button_coords[1], &button_coords[2], &button_coords[3], NULL, NULL, NULL, NULL);
+
+  // Captured on the first drawing, then blitted under the button.
+  RenderCache& cache = RenderCache::getInstance();
+  panel->set_retained(ei_retain_widget);
+  render_cache_stats_t before = cache.stats();
+  root->draw(main_window, NULL, NULL);
+  ei_copy_surface(reference, main_window, NULL, EI_FALSE);
+  fill(main_window, &black, EI_FALSE);
+  root->draw(main_window, NULL, NULL);
+  REQUIRE( cache.stats().misses == before.misses + 1 );
+  REQUIRE( cache.stats().hits == before.hits + 1 );
+  REQUIRE( cache.stats().entries == before.entries + 1 );
+  int mismatches = 0;
+  for (int y = 0; y < size.height; y++)
+    for (int x = 0; x < size.width; x++)
+      if (hw_get_pixel(main_window, Point(x, y)).red != hw_get_pixel(reference, Point(x, y)).red)
+        mismatches++;
+  REQUIRE( mismatches == 0 );
+
+  // The button is not in the offscreen of the panel, unless it keeps the whole subtree.
+  button->configure(NULL, &red, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( cache.stats().entries == before.entries + 1 );
+  panel->set_retained(ei_retain_subtree);
+  root->draw(main_window, NULL, NULL);
+  REQUIRE( cache.stats().entries == before.entries + 1 );
+  button->configure(NULL, &black, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( cache.stats().entries == before.entries );
+
+  // Changed widgets are drawn again from the primitives.
+  root->draw(main_window, NULL, NULL);
+  panel->configure(NULL, &red, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  root->draw(main_window, NULL, NULL);
+  REQUIRE( hw_get_pixel(main_window, Point(100, 100)).red == 0xff );
+
+  // A translucent widget is not captured: its background is not invalidated with it.
+  color_t translucent = {0xff, 0x00, 0x00, 0x80};
+  panel->configure(NULL, &translucent, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  before = cache.stats();
+  root->draw(main_window, NULL, NULL);
+  root->draw(main_window, NULL, NULL);
+  REQUIRE( cache.stats().entries == before.entries );
+  REQUIRE( cache.stats().hits == before.hits );
+
+  cache.set_budget(0);
+  cache.trim();
+  REQUIRE( cache.stats().bytes == 0 );
+  cache.set_budget(RenderCache::k_default_budget);
+  delete root;
+  cache.trim();
+  hw_surface_free(reference);
+}
+
+TEST_CASE("occlusion", "[unit]")
+{
+  Size size(200, 160);
+  color_t black = {0x00, 0x00, 0x00, 0xff}, translucent = {0xff, 0x00, 0x00, 0x80};
+  surface_t main_window = hw_create_window(&size, EI_FALSE);
+  surface_t reference = hw_surface_create(main_window, &size);
+  Rect screen(Point(0, 0), size);
+  Frame* root = new Frame(NULL);
+  root->geomnotify(screen);
+
+  Placer& placer = Placer::getInstance();
+  int panel_coords[] = {0, 0, 200, 160}, below_coords[] = {20, 30, 100, 60}, above_coords[] = {10, 10, 150, 120};
+  Frame* panel = new Frame(root);
+  placer.configure(panel, NULL, &panel_coords[0], &panel_coords[1], &panel_coords[2], &panel_coords[3], NULL, NULL, NULL, NULL);
+  Toplevel* below = new Toplevel(root);
+  placer.configure(below, NULL, &below_coords[0], &below_coords[1], &below_coords[2], &below_coords[3], NULL, NULL, NULL, NULL);
+  Button* button = new Button(below);
+  placer.configure(button, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  Toplevel* above = new Toplevel(root);
+  placer.configure(above, NULL, &above_coords[0], &above_coords[1], &above_coords[2], &above_coords[3], NULL, NULL, NULL, NULL);
+
+  // The toplevel below is hidden with its button, the root only by the panel.
+  OcclusionCuller& culler = OcclusionCuller::getInstance();
+  culler.prepare(root, screen);
+  REQUIRE( culler.occluded(root) == ei_occluded_widget );
+  REQUIRE( culler.occluded(panel) == ei_occluded_none );
+  REQUIRE( culler.occluded(below) == ei_occluded_subtree );
+  REQUIRE( culler.occluded(button) == ei_occluded_subtree );
+  REQUIRE( culler.occluded(above) == ei_occluded_none );
+
+  // Only what is hidden is skipped.
+  root->draw(reference, NULL, NULL);
+  fill(main_window, &black, EI_FALSE);
+  root->Widget::draw(main_window, NULL, &screen);
+  culler.finish();
+  int mismatches = 0;
+  for (int y = 0; y < size.height; y++)
+    for (int x = 0; x < size.width; x++)
+      if (hw_get_pixel(main_window, Point(x, y)).red != hw_get_pixel(reference, Point(x, y)).red)
+        mismatches++;
+  REQUIRE( mismatches == 0 );
+  REQUIRE( culler.occluded(below) == ei_occluded_none );
+
+  // Nothing is hidden under a translucent background.
+  above->configure(NULL, &translucent, NULL, NULL, NULL, NULL, NULL);
+  culler.prepare(root, screen);
+  REQUIRE( culler.occluded(below) == ei_occluded_none );
+  culler.finish();
+
+  delete root;
+  RenderCache::getInstance().trim();
+  hw_surface_free(reference);
+}
+
+TEST_CASE("configure_batch", "[unit]")
+{
+  Size size(200, 160);
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), size));
+
+  Placer& placer = Placer::getInstance();
+  int panel_coords[] = {10, 10, 100, 100}, button_coords[] = {10, 10, 40, 20}, moved[] = {90, 50};
+  Frame* panel = new Frame(root);
+  placer.configure(panel, NULL, &panel_coords[0], &panel_coords[1], &panel_coords[2], &panel_coords[3], NULL, NULL, NULL, NULL);
+  Button* button = new Button(panel);
+  placer.configure(button, NULL, &button_coords[0], &button_coords[1], &button_coords[2], &button_coords[3], NULL, NULL, NULL, NULL);
+  Button* removed = new Button(panel);
+
+  // The widgets are placed by the outermost commit.
+  ConfigureBatch& batch = ConfigureBatch::getInstance();
+  batch.begin();
+  placer.configure(panel, NULL, &moved[0], &moved[1], NULL, NULL, NULL, NULL, NULL, NULL);
+  batch.begin();
+  Size button_size(60, 30);
+  button->configure(&button_size, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  placer.configure(removed, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  delete removed;
+  batch.commit();
+  REQUIRE( batch.open() == EI_TRUE );
+  REQUIRE( root->pick(Point(25, 25)) == button );
+  batch.commit();
+  REQUIRE( batch.open() == EI_FALSE );
+  REQUIRE( root->pick(Point(25, 25)) == root );
+  REQUIRE( root->pick(Point(105, 65)) == button );
+  REQUIRE( root->pick(Point(145, 75)) == panel );
+
+  // An ancestor unmapped during the batch places nothing: its descendants are placed alone.
+  PlacedFrame* label = new PlacedFrame(panel);
+  int label_width = 70;
+  batch.begin();
+  placer.configure(panel, NULL, &panel_coords[0], &panel_coords[1], NULL, NULL, NULL, NULL, NULL, NULL);
+  placer.configure(label, NULL, NULL, NULL, &label_width, NULL, NULL, NULL, NULL, NULL);
+  placer.unmap(panel);
+  batch.commit();
+  REQUIRE( label->placed.size.width == 70 );
+
+  delete root;
+}
+
+TEST_CASE("dirty_flags", "[unit]")
+{
+  Size size(200, 160);
+  Frame* root = new Frame(NULL);
+  root->geomnotify(Rect(Point(0, 0), size));
+
+  // The requested size places the frame again, the appearance only repaints it.
+  Placer& placer = Placer::getInstance();
+  int x = 10, y = 10, border_width = 4;
+  color_t red = {0xff, 0x00, 0x00, 0xff};
+  Frame* frame = new Frame(root);
+  placer.configure(frame, NULL, &x, &y, NULL, NULL, NULL, NULL, NULL, NULL);
+  Size requested(40, 30);
+  frame->configure(&requested, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( root->pick(Point(45, 35)) == frame );
+  frame->configure(NULL, &red, &border_width, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( root->pick(Point(45, 35)) == frame );
+  REQUIRE( root->pick(Point(55, 35)) == root );
+
+  delete root;
+}
+
+TEST_CASE("dirty_flags_invalidation", "[unit]")
+{
+  Size size(200, 160);
+  Application app(&size, EI_FALSE);
+  Frame* root = app.root_widget();
+
+  // The color and the border only invalidate the pixels where the frame is: it is not placed
+  // again, which would move it back and invalidate its geometry.
+  Placer& placer = Placer::getInstance();
+  int x = 10, y = 10, border_width = 4, corner_radius = 2;
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff};
+  Frame* frame = new Frame(root);
+  placer.configure(frame, NULL, &x, &y, NULL, NULL, NULL, NULL, NULL, NULL);
+  Size requested(40, 30);
+  frame->configure(&requested, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  Rect moved(Point(60, 60), requested);
+  frame->geomnotify(moved);
+  size_t rects = app.invalidated_rects().size(), geometry = app.invalidated_geometry().size();
+  frame->configure(NULL, &red, &border_width, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( app.invalidated_rects().size() == rects + 1 );
+  REQUIRE( rect_equal(app.invalidated_rects().back(), moved) == EI_TRUE );
+  REQUIRE( app.invalidated_geometry().size() == geometry );
+
+  // The requested size places it again.
+  requested = Size(50, 30);
+  frame->configure(&requested, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( root->pick(Point(15, 15)) == frame );
+  REQUIRE( root->pick(Point(70, 70)) == root );
+  REQUIRE( app.invalidated_geometry().size() > geometry );
+
+  // The corners of a button and its color invalidate its geometry once.
+  Button* button = new Button(root);
+  placer.configure(button, NULL, &x, &y, NULL, NULL, NULL, NULL, NULL, NULL);
+  button->configure(&requested, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  rects = app.invalidated_rects().size();
+  geometry = app.invalidated_geometry().size();
+  button->configure(NULL, &blue, NULL, &corner_radius, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( app.invalidated_rects().size() == rects );
+  REQUIRE( app.invalidated_geometry().size() == geometry + 1 );
+
+  // A requested size overridden by the placer does not move the frame: its color is still
+  // redrawn.
+  Frame* sized = new Frame(root);
+  int width = 30, height = 20;
+  placer.configure(sized, NULL, &x, &y, &width, &height, NULL, NULL, NULL, NULL);
+  rects = app.invalidated_rects().size();
+  geometry = app.invalidated_geometry().size();
+  Size overridden(35, 25);
+  sized->configure(&overridden, &blue, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( app.invalidated_rects().size() == rects + 1 );
+  REQUIRE( app.invalidated_geometry().size() == geometry );
+}
+
+TEST_CASE("render_state", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t blue = {0x00, 0x00, 0xff, 0xff};
+  linked_point_t points[5];
+  Rect clipper(Point(10, 10), Size(100, 100));
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  for (int i = 0; i < 5; i++) {
+    points[i].point = Point(20 + 10 * i, 20 + (i % 2) * 10);
+    points[i].next = i < 4 ? &points[i + 1] : NULL;
+  }
+
+  // Only the first segment sets the target, blender and clip.
+  RenderState& state = RenderState::getInstance();
+  state.invalidate();
+  state.begin_frame();
+  draw_polyline(main_window, points, blue, &clipper);
+  REQUIRE( state.current_frame().target_changes == 1 );
+  REQUIRE( state.current_frame().target_avoided == 3 );
+  REQUIRE( state.current_frame().clip_changes == 1 );
+  REQUIRE( state.current_frame().clip_avoided == 3 );
+
+  // Another clipper is set again.
+  fill(main_window, &blue, EI_FALSE);
+  REQUIRE( state.current_frame().clip_changes == 2 );
+
+  state.begin_frame();
+  REQUIRE( state.last_frame().blender_changes == 1 );
+  REQUIRE( state.current_frame().blender_changes == 0 );
+}
+
+TEST_CASE("blit_batch", "[unit]")
+{
+  surface_t main_window = NULL;
+  Size main_window_size(640,480);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, blue = {0x00, 0x00, 0xff, 0xff}, query_color;
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  fill(main_window, &red, EI_FALSE);
+
+  // Labels on their own background: the backgrounds do not overlap the queued labels.
+  BlitBatch& batch = BlitBatch::getInstance();
+  batch.begin();
+  for (int i = 0; i < 20; i++) {
+    Point where(10 + 30 * (i % 10), 10 + 40 * (i / 10));
+    fill_rounded_rect(main_window, Rect(where, Size(28, 38)), 0, red, NULL);
+    draw_text(main_window, &where, "x", NULL, &blue);
+  }
+  REQUIRE( batch.current_batch().groups == 0 );
+
+  // Drawing over a queued label submits the queue first.
+  fill_rounded_rect(main_window, Rect(Point(10, 10), Size(4, 4)), 0, blue, NULL);
+  REQUIRE( batch.current_batch().groups == 1 );
+  batch.end();
+
+  REQUIRE( batch.last_batch().blits == 20 );
+  REQUIRE( batch.last_batch().groups == 1 );
+  query_color = hw_get_pixel(main_window, Point(11, 11));
+  REQUIRE( query_color.blue == blue.blue );
+
+  // Drawing into the source of a queued blit submits the queue first.
+  Size image_size(16, 16);
+  surface_t image = hw_surface_create(main_window, &image_size);
+  fill(image, &red, EI_FALSE);
+  Point where(100, 100);
+  batch.begin();
+  ei_copy_surface(main_window, image, &where, EI_FALSE);
+  fill(image, &blue, EI_FALSE);
+  batch.end();
+  query_color = hw_get_pixel(main_window, Point(104, 104));
+  REQUIRE( query_color.red == red.red );
+  REQUIRE( query_color.blue == red.blue );
+  hw_surface_free(image);
+}
+
+TEST_CASE("surface_formats", "[unit]")
+{
+  surface_t main_window = NULL, opaque = NULL, alpha = NULL;
+  Size main_window_size(640,480), offscreen_size(10,10);
+  color_t red = {0xff, 0x00, 0x00, 0xff}, half = {0x80, 0x80, 0x80, 0x80};
+  color_t orange = {0xff, 0x82, 0x00, 0xff}, query_color;
+
+  main_window = hw_create_window(&main_window_size, EI_FALSE);
+  opaque = create_surface(main_window, &offscreen_size, ei_format_rgbx8888);
+  alpha = create_surface(main_window, &offscreen_size, ei_format_a8);
+  REQUIRE( surface_get_format(opaque) == ei_format_rgbx8888 );
+  REQUIRE( surface_get_format(alpha) == ei_format_a8 );
+
+  // An opaque surface keeps its colors, and its alpha is never stored.
+  fill(opaque, &orange, EI_FALSE);
+  fill_rounded_rect(opaque, Rect(Point(0, 0), Size(5, 10)), 0, half, NULL);
+  query_color = hw_get_pixel(opaque, Point(8, 8));
+  REQUIRE( query_color.red == orange.red );
+  REQUIRE( query_color.green == orange.green );
+  REQUIRE( query_color.alpha == 0xff );
+
+  // An alpha surface is a premultiplied white: copied with alpha, it lightens.
+  fill(main_window, &red, EI_FALSE);
+  fill(alpha, &half, EI_TRUE);
+  ei_copy_surface(main_window, alpha, NULL, EI_TRUE);
+  query_color = hw_get_pixel(main_window, Point(5, 5));
+  REQUIRE( query_color.red == 0xff );
+  REQUIRE( query_color.green == 0x80 );
+  query_color = hw_get_pixel(main_window, Point(15, 15));
+  REQUIRE( query_color.green == 0x00 );
+
+  hw_surface_free(opaque);
+  hw_surface_free(alpha);
+}
+
+TEST_CASE("pick_damage", "[unit]")
+{
+  Size size(200, 160);
+  Application* app = new Application(&size, EI_FALSE);
+  app->use_pick_buffer(EI_TRUE);
+  Frame* frame = new Frame(app->root_widget());
+  Frame* child = new Frame(frame);
+  Placer& placer = Placer::getInstance();
+  int x = 20, y = 20, width = 40, height = 30, child_size = 10;
+  placer.configure(frame, NULL, &x, &y, &width, &height, NULL, NULL, NULL, NULL);
+  placer.configure(child, NULL, NULL, NULL, &child_size, &child_size, NULL, NULL, NULL, NULL);
+  app->redraw();
+  REQUIRE( app->pick_buffer()->at(Point(25, 25)) == child->getPick_id() );
+  REQUIRE( app->pick_buffer()->at(Point(50, 40)) == frame->getPick_id() );
+
+  // A color only changes the appearance: the ids are not redrawn.
+  const uint32_t marker = 0x12345678;
+  app->pick_buffer()->fill_span(40, 45, 55, marker);
+  color_t green = {0x00, 0xff, 0x00, 0xff};
+  frame->configure(NULL, &green, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( app->invalidated_geometry().empty() );
+  REQUIRE( app->invalidated_rects().size() == 1 );
+  app->redraw();
+  REQUIRE( app->pick_buffer()->at(Point(50, 40)) == marker );
+
+  // A move redraws the ids at the old and new locations, once for the child too.
+  x = 100;
+  placer.configure(frame, NULL, &x, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+  REQUIRE( app->invalidated_geometry().size() == 2 );
+  app->redraw();
+  REQUIRE( app->pick_buffer()->at(Point(50, 40)) == app->root_widget()->getPick_id() );
+  REQUIRE( app->pick_buffer()->at(Point(105, 25)) == child->getPick_id() );
+  REQUIRE( app->pick_buffer()->at(Point(130, 40)) == frame->getPick_id() );
+
+  delete app;
+}
+
 int ei_main(int argc, char* argv[])
 {
   // Init acces to hardware.